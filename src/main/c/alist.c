@@ -40,66 +40,220 @@
 #include <string.h>
 #include "alist.h"
 
-// releases each list entry, then frees the entries array (which was directly
-// allocated using realloc)
+// profiler type id for the entries arrays, registered on first use
+static int entries_type_id = -1;
+
+// a frozen, shareable copy of a list's entries. It holds one reference to
+// each entry and is never modified once created.
+typedef struct alist_buf {
+	int size;
+	void *entries[];
+} alist_buf_t;
+
+static void alist_buf_free(alist_buf_t *buf) {
+	for (int i = 0; i < buf->size; i++) {
+		mem_release(buf->entries[i]);
+	}
+}
+
+// releases each list entry, then frees the entries array if it was
+// allocated separately from the list
 static void alist_free(alist_t *list) {
+	if (list->shared != NULL) {
+		mem_release(list->shared);
+		return;
+	}
 	for (int i = 0; i < list->size; i++) {
 		mem_release(list->entries[i]);
 	}
-	free(list->entries);
+	if (list->entries != list->inline_entries) {
+		mem_profile_resize(entries_type_id, sizeof(void *) * list->capacity, 0);
+		free(list->entries);
+	}
 }
 
+// moves the entries into a separately allocated array of exactly the given
+// capacity, or back into the inline array if they fit
+static void set_capacity(alist_t *list, int capacity) {
+	if (entries_type_id < 0) {
+		entries_type_id = mem_type_id("alist_entries");
+	}
+	
+	if (capacity <= ALIST_INLINE_CAPACITY) {
+		if (list->entries != list->inline_entries) {
+			memcpy(list->inline_entries, list->entries, sizeof(void *) * list->size);
+			mem_profile_resize(entries_type_id, sizeof(void *) * list->capacity, 0);
+			free(list->entries);
+			list->entries = list->inline_entries;
+			list->capacity = ALIST_INLINE_CAPACITY;
+		}
+		return;
+	}
+	
+	void **new_ents;
+	if (list->entries == list->inline_entries) {
+		new_ents = malloc(sizeof(void *) * capacity);
+		if (new_ents != NULL) {
+			memcpy(new_ents, list->inline_entries, sizeof(void *) * list->size);
+			mem_profile_resize(entries_type_id, 0, sizeof(void *) * capacity);
+		}
+	} else {
+		new_ents = realloc(list->entries, sizeof(void *) * capacity);
+		if (new_ents != NULL) {
+			mem_profile_resize(entries_type_id, sizeof(void *) * list->capacity, sizeof(void *) * capacity);
+		}
+	}
+	if (new_ents == NULL) {
+		perror("Failed to resize arraylist");
+		exit(1);
+	}
+	list->entries = new_ents;
+	list->capacity = capacity;
+}
+
+// grows the list geometrically, so that appending is amortized O(1)
 static void ensure_capacity(alist_t *list, int capacity) {
 	if (capacity > list->capacity) {
-		void *new_ents = realloc(list->entries, sizeof(void *) * capacity);
-		if (new_ents == NULL) {
-			perror("Failed to resize arraylist");
-			exit(1);
+		int new_capacity = list->capacity * 2;
+		set_capacity(list, capacity > new_capacity ? capacity : new_capacity);
+	}
+}
+
+// moves a list's entries into a shared buffer (without touching their
+// reference counts) so that copies of the list can share them
+static void freeze(alist_t *list) {
+	if (list->shared != NULL) {
+		return;
+	}
+	
+	alist_buf_t *buf = mem_alloc(sizeof(alist_buf_t) + sizeof(void *) * list->size,
+								 (void (*)(void*)) alist_buf_free, "alist_buf");
+	buf->size = list->size;
+	memcpy(buf->entries, list->entries, sizeof(void *) * list->size);
+	
+	if (list->entries != list->inline_entries) {
+		mem_profile_resize(entries_type_id, sizeof(void *) * list->capacity, 0);
+		free(list->entries);
+	}
+	list->entries = buf->entries;
+	list->capacity = list->size;
+	list->shared = buf;
+}
+
+// gives a list that shares its entries a private copy of them with room for
+// at least capacity entries, leaving out the entry at index skip (pass -1 to
+// keep all of them). The entry that is left out is not retained by the list
+// any more, so this doubles as the first step of a removal.
+static void materialize(alist_t *list, int capacity, int skip) {
+	alist_buf_t *buf = list->shared;
+	
+	list->shared = NULL;
+	list->size = 0;
+	list->entries = list->inline_entries;
+	list->capacity = ALIST_INLINE_CAPACITY;
+	alist_reserve(list, capacity > buf->size ? capacity : buf->size);
+	
+	for (int i = 0; i < buf->size; i++) {
+		if (i != skip) {
+			list->entries[list->size] = buf->entries[i];
+			mem_retain(list->entries[list->size]);
+			list->size++;
 		}
-		list->entries = new_ents;
-		list->capacity = capacity;
 	}
+	
+	mem_release(buf);
 }
 
 alist_t *alist_new() {
 	return alist_new_sized(10);
 }
 
-alist_t *alist_new_sized(int initial_capacity) {
-	alist_t *alist = mem_alloc(sizeof(alist_t), (void (*)(void*)) alist_free, "alist");
+// allocator is either mem_alloc or mem_region_alloc
+static alist_t *new_sized(int initial_capacity,
+						  void *(*allocator)(size_t, void (*)(void *), const char *)) {
+	alist_t *alist = allocator(sizeof(alist_t), (void (*)(void*)) alist_free, "alist");
 	
-	alist->capacity = 0;
+	alist->capacity = ALIST_INLINE_CAPACITY;
 	alist->size = 0;
-	alist->entries = NULL;
+	alist->entries = alist->inline_entries;
+	alist->shared = NULL;
 	
-	ensure_capacity(alist, initial_capacity);
+	alist_reserve(alist, initial_capacity);
 	
 	return alist;
 }
 
-alist_t *alist_new_copy(alist_t *src) {
-	alist_t *alist = mem_alloc(sizeof(alist_t), (void (*)(void*)) alist_free, "alist_copy");
+alist_t *alist_new_sized(int initial_capacity) {
+	return new_sized(initial_capacity, mem_alloc);
+}
+
+alist_t *alist_new_in_region() {
+	return new_sized(10, mem_region_alloc);
+}
+
+static alist_t *new_copy(alist_t *src,
+						 void *(*allocator)(size_t, void (*)(void *), const char *)) {
+	alist_t *alist = allocator(sizeof(alist_t), (void (*)(void*)) alist_free, "alist_copy");
 	
-	alist->capacity = 0;
-	alist->size = src->size;
-	alist->entries = NULL;
+	freeze(src);
+	mem_retain(src->shared);
 	
-	ensure_capacity(alist, src->capacity);
-	for (int i = 0; i < src->size; i++) {
-		alist->entries[i] = src->entries[i];
-		mem_retain(alist->entries[i]);
-	}
+	alist->capacity = src->capacity;
+	alist->size = src->size;
+	alist->entries = src->entries;
+	alist->shared = src->shared;
 	
 	return alist;
 }
 
+alist_t *alist_new_copy(alist_t *src) {
+	return new_copy(src, mem_alloc);
+}
+
+alist_t *alist_new_copy_in_region(alist_t *src) {
+	return new_copy(src, mem_region_alloc);
+}
+
+void alist_reserve(alist_t *list, int capacity) {
+	if (list->shared != NULL) {
+		materialize(list, capacity, -1);
+	} else if (capacity > list->capacity) {
+		set_capacity(list, capacity);
+	}
+}
+
+void alist_shrink_to_fit(alist_t *list) {
+	if (list->shared == NULL && list->capacity > list->size) {
+		set_capacity(list, list->size);
+	}
+}
+
 void alist_add(alist_t *list, void *item) {
+	if (list->shared != NULL) {
+		materialize(list, list->size + 1, -1);
+	}
 	ensure_capacity(list, list->size + 1);
 	list->entries[list->size] = item;
 	list->size = list->size + 1;
 	mem_retain(item);
 }
 
+void alist_insert_at(alist_t *list, int idx, void *item) {
+	if (idx < 0 || idx > list->size) {
+		printf("alist_insert_at: index out of bounds. idx=%d; size=%d\n", idx, list->size);
+		exit(1);
+	}
+	
+	if (list->shared != NULL) {
+		materialize(list, list->size + 1, -1);
+	}
+	ensure_capacity(list, list->size + 1);
+	memmove(list->entries + idx + 1, list->entries + idx, sizeof(void *) * (list->size - idx));
+	list->entries[idx] = item;
+	list->size = list->size + 1;
+	mem_retain(item);
+}
+
 // 0 1 2 3 4 5 6  -- size == 7
 // remove 1
 // 0 2 3 4 5 6    -- 5 items starting at 2 (5 == size - startidx)
@@ -109,13 +263,33 @@ void alist_remove_at(alist_t *list, int idx) {
 		exit(1);
 	}
 	
+	if (list->shared != NULL) {
+		materialize(list, list->size - 1, idx);
+		return;
+	}
+	
 	mem_release(list->entries[idx]);
 	
-	//memmove(list->entries + idx, list->entries + idx + 1, list->size - (idx + 1));
-	for (int i = idx; i < (list->size - 1); i++) {
-		list->entries[i] = list->entries[i + 1];
+	memmove(list->entries + idx, list->entries + idx + 1, sizeof(void *) * (list->size - (idx + 1)));
+	list->size = list->size - 1;
+	list->entries[list->size] = NULL;
+}
+
+void alist_swap_remove(alist_t *list, int idx) {
+	if (idx < 0 || idx >= list->size) {
+		printf("alist_swap_remove: index out of bounds. idx=%d; size=%d\n", idx, list->size);
+		exit(1);
+	}
+	
+	if (list->shared != NULL) {
+		materialize(list, list->size - 1, idx);
+		return;
 	}
+	
+	mem_release(list->entries[idx]);
+	
 	list->size = list->size - 1;
+	list->entries[idx] = list->entries[list->size];
 	list->entries[list->size] = NULL;
 }
 
@@ -132,7 +306,191 @@ int alist_remove(alist_t *list, void *item, int (*comparator)(void *, void *)) {
 	}
 }
 
+// does the work of alist_remove_many() in a single pass over the list,
+// leaving room for extra more entries afterwards. If the list was sharing
+// its entries, the pass also builds its private copy of the survivors.
+static int remove_many(alist_t *list, void **items, int count,
+					   int (*comparator)(void *, void *), int extra) {
+	alist_buf_t *buf = list->shared;
+	void **src = list->entries;
+	int n = list->size;
+	
+	if (buf != NULL) {
+		list->shared = NULL;
+		list->size = 0;
+		list->entries = list->inline_entries;
+		list->capacity = ALIST_INLINE_CAPACITY;
+		alist_reserve(list, n + extra);
+	} else {
+		ensure_capacity(list, n + extra);
+		src = list->entries;
+	}
+	
+	char removed[count > 0 ? count : 1];
+	for (int j = 0; j < count; j++) {
+		removed[j] = 0;
+	}
+	
+	int found = 0;
+	int kept = 0;
+	int i;
+	for (i = 0; i < n && found < count; i++) {
+		void *entry = src[i];
+		int match = 0;
+		for (int j = 0; j < count; j++) {
+			if (!removed[j] && comparator(items[j], entry) == 0) {
+				removed[j] = 1;
+				match = 1;
+				break;
+			}
+		}
+		if (match) {
+			found++;
+			if (buf == NULL) {
+				mem_release(entry);
+			}
+		} else {
+			if (buf != NULL) {
+				mem_retain(entry);
+			}
+			list->entries[kept++] = entry;
+		}
+	}
+	
+	// everything past the last removed entry just shifts down
+	if (buf != NULL) {
+		for (; i < n; i++) {
+			list->entries[kept] = src[i];
+			mem_retain(list->entries[kept]);
+			kept++;
+		}
+		mem_release(buf);
+	} else {
+		memmove(list->entries + kept, src + i, sizeof(void *) * (n - i));
+		kept += n - i;
+		for (i = kept; i < n; i++) {
+			list->entries[i] = NULL;
+		}
+	}
+	list->size = kept;
+	
+	return found;
+}
+
+int alist_remove_many(alist_t *list, void **items, int count, int (*comparator)(void *, void *)) {
+	return remove_many(list, items, count, comparator, 0);
+}
+
+int alist_replace(alist_t *list, void **items, int count, void *item,
+				  int (*comparator)(void *, void *)) {
+	int found = remove_many(list, items, count, comparator, 1);
+	alist_add(list, item);
+	return found;
+}
+
+int alist_replace_sorted(alist_t *list, void **items, int count, void *item,
+						 int (*comparator)(void *, void *)) {
+	// the items in the list's order, so that they can be merged against it
+	void *sorted[count > 0 ? count : 1];
+	for (int j = 0; j < count; j++) {
+		int k = j;
+		while (k > 0 && comparator(sorted[k - 1], items[j]) > 0) {
+			sorted[k] = sorted[k - 1];
+			k--;
+		}
+		sorted[k] = items[j];
+	}
+	
+	alist_buf_t *buf = list->shared;
+	void **src = list->entries;
+	int n = list->size;
+	
+	if (buf != NULL) {
+		list->shared = NULL;
+		list->size = 0;
+		list->entries = list->inline_entries;
+		list->capacity = ALIST_INLINE_CAPACITY;
+		alist_reserve(list, n + 1);
+	} else {
+		ensure_capacity(list, n + 1);
+		src = list->entries;
+	}
+	
+	// a private copy is merged into as it's built. In place, item can't go
+	// in until the pass is over, so only its index is noted.
+	int pending = 1;
+	int at = -1;
+	int found = 0;
+	int kept = 0;
+	int i;
+	int j = 0;
+	for (i = 0; i < n && (j < count || (pending && at < 0)); i++) {
+		void *entry = src[i];
+		while (j < count && comparator(entry, sorted[j]) > 0) {
+			j++;  // sorted[j] isn't in the list
+		}
+		if (j < count && comparator(entry, sorted[j]) == 0) {
+			j++;
+			found++;
+			if (buf == NULL) {
+				mem_release(entry);
+			}
+			continue;
+		}
+		
+		if (pending && at < 0) {
+			int cmp = comparator(entry, item);
+			if (cmp == 0) {
+				pending = 0;  // already there
+			} else if (cmp > 0 && buf != NULL) {
+				list->entries[kept++] = item;
+				mem_retain(item);
+				pending = 0;
+			} else if (cmp > 0) {
+				at = kept;
+			}
+		}
+		if (buf != NULL) {
+			mem_retain(entry);
+		}
+		list->entries[kept++] = entry;
+	}
+	
+	// everything past that just shifts down
+	if (buf != NULL) {
+		for (; i < n; i++) {
+			list->entries[kept] = src[i];
+			mem_retain(list->entries[kept]);
+			kept++;
+		}
+		mem_release(buf);
+	} else {
+		memmove(list->entries + kept, src + i, sizeof(void *) * (n - i));
+		kept += n - i;
+	}
+	
+	if (pending) {
+		if (at < 0) {
+			at = kept;
+		}
+		memmove(list->entries + at + 1, list->entries + at, sizeof(void *) * (kept - at));
+		list->entries[at] = item;
+		mem_retain(item);
+		kept++;
+	}
+	for (i = kept; i < n; i++) {
+		list->entries[i] = NULL;
+	}
+	list->size = kept;
+	
+	return found;
+}
+
 void alist_remove_last(alist_t *list) {
+	if (list->shared != NULL) {
+		materialize(list, list->size - 1, list->size - 1);
+		return;
+	}
 	list->size = list->size - 1;
 	mem_release(list->entries[list->size]);
 	list->entries[list->size] = NULL;
@@ -40,25 +40,80 @@
 #ifndef __ALIST_H__
 #define __ALIST_H__
 
+// number of entries a list can hold before it needs to allocate a separate
+// entries array. This covers a whole 15-hole board or a node's legal moves.
+#define ALIST_INLINE_CAPACITY 20
+
+// Copies made with alist_new_copy() are copy-on-write: the source and the
+// copy share one reference counted, read-only buffer of entries until one of
+// them is modified, at which point only that list gets its own entries again.
+// The shared buffer holds the references to the entries, so the lists that
+// share it don't retain them individually.
+struct alist_buf;
+
 typedef struct alist {
 	int size;
 	int capacity;
-	void **entries;
+	void **entries;  // inline_entries, a malloc'd array, or shared->entries
+	struct alist_buf *shared;  // NULL unless the entries are shared
+	void *inline_entries[ALIST_INLINE_CAPACITY];
 } alist_t;
 
 alist_t *alist_new();
 alist_t *alist_new_sized(int initial_capacity);
+
+// returns a copy-on-write copy of src. Neither list copies its entries
+// until it is next modified.
 alist_t *alist_new_copy(alist_t *src);
 
-// adds an item to this list.
+// variants of alist_new() and alist_new_copy() which allocate the list
+// from the allocation region (see mem_region_alloc()). The list's entries
+// are still retained and released as usual.
+alist_t *alist_new_in_region();
+alist_t *alist_new_copy_in_region(alist_t *src);
+
+// makes room for at least capacity entries, so that adding up to that many
+// entries won't need to allocate
+void alist_reserve(alist_t *list, int capacity);
+
+// gives back any room the list has beyond its current size, moving the
+// entries back into the list itself if they fit
+void alist_shrink_to_fit(alist_t *list);
+
+// adds an item to this list. The list grows geometrically as needed.
 // item must be a pointer that was allocated by mem_alloc().
 void alist_add(alist_t *list, void *item);
+
+// inserts item at idx, shifting the entries from idx onwards up by one
+void alist_insert_at(alist_t *list, int idx, void *item);
 void alist_remove_at(alist_t *list, int idx);
 
+
+// removes the entry at idx by moving the last entry into its place. This is
+// O(1), but doesn't preserve the order of the list.
+void alist_swap_remove(alist_t *list, int idx);
+
 /* Returns 1 if item was removed; 0 if item was not found */
 // item must be a pointer that was allocated by mem_alloc().
 int alist_remove(alist_t *list, void *item, int (*comparator)(void *, void *));
 
+// removes the first entry matching each of the count items in a single pass,
+// keeping the remaining entries in order. Returns the number of items that
+// were found and removed.
+int alist_remove_many(alist_t *list, void **items, int count, int (*comparator)(void *, void *));
+
+// same as alist_remove_many() followed by alist_add(list, item), but only
+// touches each entry once
+int alist_replace(alist_t *list, void **items, int count, void *item,
+				  int (*comparator)(void *, void *));
+
+// same as alist_replace() for a list sorted by comparator, keeping it
+// sorted: the items are merged against the entries, and item goes in where
+// it belongs unless an entry equal to it is left. A list that was sharing
+// its entries gets its private copy built by the same pass.
+int alist_replace_sorted(alist_t *list, void **items, int count, void *item,
+						 int (*comparator)(void *, void *));
+
 void alist_remove_last(alist_t *list);
 void *alist_get(alist_t *list, int idx);
 int alist_contains(alist_t *list, void *item, int (*comparator)(void *, void *));
@@ -0,0 +1,206 @@
+/*
+ *  alist_check.c
+ *  performance_c
+ *
+ *  Regression checks for alist, built and run by "make check". Kept out of
+ *  the performance binary; build with -fsanitize=address to catch overruns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "alist.h"
+#include "memory.h"
+
+// more than fits inline, so the shared buffer is bigger than inline_entries
+#define ITEM_COUNT (ALIST_INLINE_CAPACITY + 10)
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+
+// lists come out of slab pools, so reading past one's inline entries lands
+// in its neighbour rather than in a redzone. This fences off the memory just
+// past a list so that AddressSanitizer catches such reads anyway.
+#define FENCE_SIZE (sizeof(void *) * ITEM_COUNT)
+#define FENCE(list) __asan_poison_memory_region((list) + 1, FENCE_SIZE)
+#define UNFENCE(list) __asan_unpoison_memory_region((list) + 1, FENCE_SIZE)
+#else
+#define FENCE(list)
+#define UNFENCE(list)
+#endif
+
+static int failures = 0;
+
+static int int_cmp(void *lhs, void *rhs) {
+	return *(int *) lhs - *(int *) rhs;
+}
+
+static void int_free(int *item) {
+	(void) item;
+}
+
+static int *new_int(int n) {
+	int *item = mem_alloc(sizeof(int), (void (*)(void*)) int_free, "check_int");
+	*item = n;
+	return item;
+}
+
+static alist_t *new_filled() {
+	alist_t *list = alist_new();
+	for (int i = 0; i < ITEM_COUNT; i++) {
+		int *item = new_int(i);
+		alist_add(list, item);
+		mem_release(item);
+	}
+	return list;
+}
+
+// checks that list holds 0 .. ITEM_COUNT - 1 in order, apart from skip_a and
+// skip_b, followed by last (pass -1 for none)
+static void expect(const char *what, alist_t *list, int skip_a, int skip_b, int last) {
+	int idx = 0;
+	for (int i = 0; i < ITEM_COUNT; i++) {
+		if (i == skip_a || i == skip_b) {
+			continue;
+		}
+		if (idx >= alist_size(list) || *(int *) alist_get(list, idx) != i) {
+			printf("%s: expected %d at index %d\n", what, i, idx);
+			failures++;
+			return;
+		}
+		idx++;
+	}
+	if (last >= 0) {
+		if (idx >= alist_size(list) || *(int *) alist_get(list, idx) != last) {
+			printf("%s: expected %d at the end\n", what, last);
+			failures++;
+			return;
+		}
+		idx++;
+	}
+	if (idx != alist_size(list)) {
+		printf("%s: expected size %d, got %d\n", what, idx, alist_size(list));
+		failures++;
+	}
+}
+
+// removing from a copy-on-write copy of a list too long to store inline
+static void check_remove_many_from_copy() {
+	alist_t *list = new_filled();
+	alist_t *copy = alist_new_copy(list);
+	
+	int a = 3, b = ITEM_COUNT - 2;
+	void *items[2] = { &a, &b };
+	FENCE(copy);
+	int found = alist_remove_many(copy, items, 2, int_cmp);
+	UNFENCE(copy);
+	if (found != 2) {
+		printf("remove_many: found %d of 2\n", found);
+		failures++;
+	}
+	expect("remove_many copy", copy, a, b, -1);
+	expect("remove_many original", list, -1, -1, -1);
+	
+	mem_release(copy);
+	mem_release(list);
+}
+
+static void check_replace_in_copy() {
+	alist_t *list = new_filled();
+	alist_t *copy = alist_new_copy(list);
+	
+	int a = 0, b = ITEM_COUNT - 1;
+	void *items[2] = { &a, &b };
+	int *item = new_int(ITEM_COUNT);
+	FENCE(copy);
+	int found = alist_replace(copy, items, 2, item, int_cmp);
+	UNFENCE(copy);
+	mem_release(item);
+	if (found != 2) {
+		printf("replace: found %d of 2\n", found);
+		failures++;
+	}
+	expect("replace copy", copy, a, b, ITEM_COUNT);
+	expect("replace original", list, -1, -1, -1);
+	
+	mem_release(copy);
+	mem_release(list);
+}
+
+// reserving less room than a copy-on-write copy of a long list already needs
+static void check_small_reserve_on_copy() {
+	alist_t *list = new_filled();
+	alist_t *copy = alist_new_copy(list);
+	
+	FENCE(copy);
+	alist_reserve(copy, 1);
+	UNFENCE(copy);
+	expect("small reserve copy", copy, -1, -1, -1);
+	expect("small reserve original", list, -1, -1, -1);
+	
+	mem_release(copy);
+	mem_release(list);
+}
+
+// copies of lists of many different lengths, whose shared buffers are all
+// different sizes, mustn't run the allocator out of size classes
+static void check_many_lengths() {
+	int *item = new_int(0);
+	alist_t *list = alist_new();
+	for (int length = 1; length <= 1000; length++) {
+		alist_add(list, item);
+		alist_t *copy = alist_new_copy(list);
+		if (alist_size(copy) != length) {
+			printf("many lengths: copy of %d entries has %d\n", length, alist_size(copy));
+			failures++;
+		}
+		mem_release(copy);
+		alist_add(list, item);  // unshares the list again
+		alist_remove_last(list);
+	}
+	mem_release(list);
+	mem_release(item);
+}
+
+// alist_replace_sorted() on a sorted list, both on a copy and in place
+static void check_replace_sorted(int shared, int a, int b, int insert, int skip_a, int skip_b, int last) {
+	alist_t *list = new_filled();
+	alist_t *target = shared ? alist_new_copy(list) : list;
+	
+	void *items[2] = { &a, &b };
+	int *item = new_int(insert);
+	FENCE(target);
+	int found = alist_replace_sorted(target, items, 2, item, int_cmp);
+	UNFENCE(target);
+	mem_release(item);
+	if (found != 2) {
+		printf("replace_sorted: found %d of 2\n", found);
+		failures++;
+	}
+	expect(shared ? "replace_sorted copy" : "replace_sorted in place", target, skip_a, skip_b, last);
+	
+	if (shared) {
+		expect("replace_sorted original", list, -1, -1, -1);
+		mem_release(target);
+	}
+	mem_release(list);
+}
+
+int main () {
+	check_remove_many_from_copy();
+	check_replace_in_copy();
+	check_small_reserve_on_copy();
+	check_many_lengths();
+	for (int shared = 0; shared <= 1; shared++) {
+		// item put back where one was removed, item already there, item last
+		check_replace_sorted(shared, 20, 5, 5, 20, -1, -1);
+		check_replace_sorted(shared, 7, 3, 10, 3, 7, -1);
+		check_replace_sorted(shared, 1, 0, ITEM_COUNT, 0, 1, ITEM_COUNT);
+	}
+	
+	if (failures > 0) {
+		printf("alist: %d check(s) failed\n", failures);
+		exit(1);
+	}
+	printf("alist: all checks passed\n");
+	return 0;
+}
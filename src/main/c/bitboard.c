@@ -0,0 +1,344 @@
+/*
+ *  bitboard.c
+ *  performance_c
+ */
+
+#include "bitboard.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// tables built so far, indexed by row count
+static bitboard_tables_t **tables = NULL;
+static int table_count = 0;
+
+static bitboard_tables_t *tables_new(const board_t *board) {
+	if (board->hole_count > BITBOARD_MAX_HOLES || board->jump_count > BITBOARD_MAX_JUMPS) {
+		printf("A %d-row board has too many holes for a bitboard (%d; the limit is %d). "
+			   "Build with a larger -DBITBOARD_WORDS.\n",
+			   board->rowcount, board->hole_count, BITBOARD_MAX_HOLES);
+		exit(1);
+	}
+	
+	bitboard_tables_t *t = mem_alloc_immortal(sizeof(bitboard_tables_t), "bitboard_jumps");
+	bitboard_jump_t *jumps = mem_alloc_immortal(sizeof(bitboard_jump_t) * board->jump_count, "bitboard_jumps");
+	for (int i = 0; i < board->jump_count; i++) {
+		jumps[i].from = bitboard_bits_bit(board->jumps[i].from);
+		jumps[i].jumped = bitboard_bits_bit(board->jumps[i].jumped);
+		jumps[i].to = bitboard_bits_bit(board->jumps[i].to);
+		jumps[i].zobrist = board->jumps[i].zobrist;
+	}
+	t->jumps = jumps;
+	
+	int padded = (board->jump_count + BITBOARD_KERNEL_WIDTH - 1) / BITBOARD_KERNEL_WIDTH * BITBOARD_KERNEL_WIDTH;
+	bitboard_bits_t *need = mem_alloc_immortal(sizeof(bitboard_bits_t) * padded, "bitboard_jumps");
+	bitboard_bits_t *mask = mem_alloc_immortal(sizeof(bitboard_bits_t) * padded, "bitboard_jumps");
+	for (int i = 0; i < padded; i++) {
+		if (i < board->jump_count) {
+			need[i] = bitboard_bits_or(jumps[i].from, jumps[i].jumped);
+			mask[i] = bitboard_bits_or(need[i], jumps[i].to);
+		} else {
+			// (pegs & 0) never equals a non-empty set
+			need[i] = bitboard_bits_bit(0);
+			mask[i] = bitboard_bits_zero();
+		}
+	}
+	t->padded_count = padded;
+	t->need = need;
+	t->mask = mask;
+	
+	// A jump empties its from and jumped holes and fills its to hole. The
+	// jumps that start at or pass over the holes it empties leave the from
+	// and jumped sets, and the jumps that land in them join the to set; the
+	// hole it fills does the opposite.
+	int words = (board->jump_count + 63) / 64;
+	int update_words = BITBOARD_LEGAL_UPDATES * words;
+	bitboard_word_t *updates = mem_alloc_immortal(sizeof(bitboard_word_t) * update_words * board->jump_count,
+												  "bitboard_jumps");
+	for (int i = 0; i < board->jump_count * update_words; i++) {
+		updates[i] = 0;
+	}
+	for (int i = 0; i < board->jump_count; i++) {
+		const board_jump_t *ji = &board->jumps[i];
+		bitboard_word_t *u = updates + i * update_words;
+		for (int j = 0; j < board->jump_count; j++) {
+			const board_jump_t *jj = &board->jumps[j];
+			bitboard_word_t bit = (bitboard_word_t) 1 << (j % 64);
+			int w = j / 64;
+			if (jj->from == ji->from || jj->from == ji->jumped) {
+				u[BITBOARD_FROM_CLEAR * words + w] |= bit;
+			} else if (jj->from == ji->to) {
+				u[BITBOARD_FROM_SET * words + w] |= bit;
+			}
+			if (jj->jumped == ji->from || jj->jumped == ji->jumped) {
+				u[BITBOARD_JUMPED_CLEAR * words + w] |= bit;
+			} else if (jj->jumped == ji->to) {
+				u[BITBOARD_JUMPED_SET * words + w] |= bit;
+			}
+			if (jj->to == ji->from || jj->to == ji->jumped) {
+				u[BITBOARD_TO_SET * words + w] |= bit;
+			} else if (jj->to == ji->to) {
+				u[BITBOARD_TO_CLEAR * words + w] |= bit;
+			}
+		}
+	}
+	t->legal_updates = updates;
+	t->legal_words = words;
+	
+	t->transform_bytes = (board->hole_count + 7) / 8;
+	bitboard_bits_t *transforms = mem_alloc_immortal(sizeof(bitboard_bits_t) * BOARD_SYMMETRIES * t->transform_bytes * 256,
+													 "bitboard_jumps");
+	for (int s = 0; s < BOARD_SYMMETRIES; s++) {
+		const coord_index_t *map = board->symmetry + s * board->hole_count;
+		for (int k = 0; k < t->transform_bytes; k++) {
+			for (int v = 0; v < 256; v++) {
+				bitboard_bits_t bits = bitboard_bits_zero();
+				for (int b = 0; b < 8; b++) {
+					coord_index_t h = k * 8 + b;
+					if ((v >> b) & 1 && h < board->hole_count) {
+						bits = bitboard_bits_or(bits, bitboard_bits_bit(map[h]));
+					}
+				}
+				transforms[(s * t->transform_bytes + k) * 256 + v] = bits;
+			}
+		}
+	}
+	t->transforms = transforms;
+	
+	return t;
+}
+
+const bitboard_tables_t *bitboard_tables(const board_t *board) {
+	int rows = board->rowcount;
+	if (rows >= table_count) {
+		bitboard_tables_t **new_tables = realloc(tables, sizeof(bitboard_tables_t *) * (rows + 1));
+		if (new_tables == NULL) {
+			perror("Failed to grow the bitboard jump table");
+			exit(1);
+		}
+		for (int i = table_count; i <= rows; i++) {
+			new_tables[i] = NULL;
+		}
+		tables = new_tables;
+		table_count = rows + 1;
+	}
+	
+	if (tables[rows] == NULL) {
+		tables[rows] = tables_new(board);
+	}
+	return tables[rows];
+}
+
+bitboard_t bitboard_new(int rows, coord_index_t empty_hole) {
+	bitboard_t bb;
+	bb.board = board_get(rows);
+	bb.tables = bitboard_tables(bb.board);
+	
+	bb.pegs = bitboard_bits_zero();
+	for (int i = 0; i < bb.board->hole_count; i++) {
+		if (i != empty_hole) {
+			bb.pegs = bitboard_bits_or(bb.pegs, bitboard_bits_bit(i));
+		}
+	}
+	bb.hash = bitboard_compute_hash(bb);
+	return bb;
+}
+
+uint64_t bitboard_compute_hash(bitboard_t bb) {
+	uint64_t hash = 0;
+	for (coord_index_t h = 0; h < bb.board->hole_count; h++) {
+		if (bitboard_bits_test(bb.pegs, h)) {
+			hash ^= bb.board->zobrist[h];
+		}
+	}
+	return hash;
+}
+
+void bitboard_check_hash(bitboard_t bb) {
+	uint64_t expected = bitboard_compute_hash(bb);
+	if (bb.hash != expected) {
+		printf("Bitboard hash is %016llx, but its pegs hash to %016llx:\n",
+			   (unsigned long long) bb.hash, (unsigned long long) expected);
+		bitboard_print(bb);
+		exit(1);
+	}
+}
+
+static int legal_moves_scalar(const bitboard_tables_t *t, bitboard_bits_t pegs, int *moves) {
+	int count = 0;
+	for (int i = 0; i < t->padded_count; i++) {
+		if (bitboard_bits_eq(bitboard_bits_and(pegs, t->mask[i]), t->need[i])) {
+			moves[count++] = i;
+		}
+	}
+	return count;
+}
+
+#if !defined(BITBOARD_NO_SIMD) && BITBOARD_WORDS == 1 && defined(__GNUC__) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define HAVE_SIMD_KERNELS 1
+#include <immintrin.h>
+
+__attribute__((target("sse4.1")))
+static int legal_moves_sse4(const bitboard_tables_t *t, bitboard_bits_t pegs, int *moves) {
+	__m128i p = _mm_set1_epi64x((long long) pegs);
+	int count = 0;
+	for (int i = 0; i < t->padded_count; i += 2) {
+		__m128i m = _mm_loadu_si128((const __m128i *) (t->mask + i));
+		__m128i n = _mm_loadu_si128((const __m128i *) (t->need + i));
+		int hits = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(_mm_and_si128(p, m), n)));
+		while (hits) {
+			moves[count++] = i + __builtin_ctz(hits);
+			hits &= hits - 1;
+		}
+	}
+	return count;
+}
+
+__attribute__((target("avx2")))
+static int legal_moves_avx2(const bitboard_tables_t *t, bitboard_bits_t pegs, int *moves) {
+	__m256i p = _mm256_set1_epi64x((long long) pegs);
+	int count = 0;
+	for (int i = 0; i < t->padded_count; i += 4) {
+		__m256i m = _mm256_loadu_si256((const __m256i *) (t->mask + i));
+		__m256i n = _mm256_loadu_si256((const __m256i *) (t->need + i));
+		int hits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(p, m), n)));
+		while (hits) {
+			moves[count++] = i + __builtin_ctz(hits);
+			hits &= hits - 1;
+		}
+	}
+	return count;
+}
+#endif
+
+typedef int (*legal_moves_kernel_t)(const bitboard_tables_t *, bitboard_bits_t, int *);
+
+static const char *kernel_names[BITBOARD_KERNELS] = { "scalar", "sse4", "avx2" };
+
+static int selected_kernel = -1;
+static legal_moves_kernel_t kernel_fn = NULL;
+
+const char *bitboard_kernel_name(int kernel) {
+	return kernel_names[kernel];
+}
+
+int bitboard_kernel_supported(int kernel) {
+	switch (kernel) {
+		case BITBOARD_KERNEL_SCALAR:
+			return 1;
+#ifdef HAVE_SIMD_KERNELS
+		case BITBOARD_KERNEL_SSE4:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.1");
+		case BITBOARD_KERNEL_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return 0;
+	}
+}
+
+void bitboard_select_kernel(int kernel) {
+	if (kernel < 0 || kernel >= BITBOARD_KERNELS || !bitboard_kernel_supported(kernel)) {
+		printf("The %s legal move kernel isn't supported here\n",
+			   kernel >= 0 && kernel < BITBOARD_KERNELS ? kernel_names[kernel] : "requested");
+		exit(1);
+	}
+	
+	switch (kernel) {
+#ifdef HAVE_SIMD_KERNELS
+		case BITBOARD_KERNEL_SSE4:
+			kernel_fn = legal_moves_sse4;
+			break;
+		case BITBOARD_KERNEL_AVX2:
+			kernel_fn = legal_moves_avx2;
+			break;
+#endif
+		default:
+			kernel_fn = legal_moves_scalar;
+			break;
+	}
+	selected_kernel = kernel;
+}
+
+int bitboard_kernel(void) {
+	if (selected_kernel < 0) {
+		int best = BITBOARD_KERNEL_SCALAR;
+		for (int k = 0; k < BITBOARD_KERNELS; k++) {
+			if (bitboard_kernel_supported(k)) {
+				best = k;
+			}
+		}
+		bitboard_select_kernel(best);
+	}
+	return selected_kernel;
+}
+
+int bitboard_legal_moves(bitboard_t bb, int *moves) {
+	if (kernel_fn == NULL) {
+		bitboard_kernel();
+	}
+	return kernel_fn(bb.tables, bb.pegs, moves);
+}
+
+void bitboard_legal_set_init(bitboard_t bb, bitboard_legal_set_t *set) {
+	for (int w = 0; w < BITBOARD_LEGAL_WORDS; w++) {
+		set->from[w] = 0;
+		set->jumped[w] = 0;
+		set->to[w] = 0;
+	}
+	for (int i = 0; i < bb.board->jump_count; i++) {
+		const board_jump_t *j = &bb.board->jumps[i];
+		bitboard_word_t bit = (bitboard_word_t) 1 << (i % 64);
+		if (bitboard_is_occupied(bb, j->from)) {
+			set->from[i / 64] |= bit;
+		}
+		if (bitboard_is_occupied(bb, j->jumped)) {
+			set->jumped[i / 64] |= bit;
+		}
+		if (!bitboard_is_occupied(bb, j->to)) {
+			set->to[i / 64] |= bit;
+		}
+	}
+}
+
+bitboard_bits_t bitboard_canonical(bitboard_t bb) {
+	bitboard_bits_t best = bb.pegs;
+	for (int s = 1; s < BOARD_SYMMETRIES; s++) {
+		bitboard_bits_t t = bitboard_transform(bb, s);
+		if (bitboard_bits_cmp(&t, &best) < 0) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+int bitboard_stabilizer(bitboard_t bb) {
+	int stabilizer = 1;
+	for (int s = 1; s < BOARD_SYMMETRIES; s++) {
+		if (bitboard_bits_eq(bitboard_transform(bb, s), bb.pegs)) {
+			stabilizer |= 1 << s;
+		}
+	}
+	return stabilizer;
+}
+
+void bitboard_print(bitboard_t bb) {
+	printf("Game with %d pegs:\n", bitboard_pegs_remaining(bb));
+	for (int row = 1; row <= bb.board->rowcount; row++) {
+		int indent = bb.board->rowcount - row;
+		for (int i = 0; i < indent; i++) {
+			printf(" ");
+		}
+		for (int hole = 1; hole <= row; hole++) {
+			if (bitboard_is_occupied(bb, coord_index(row, hole))) {
+				printf(" *");
+			} else {
+				printf(" O");
+			}
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,238 @@
+/*
+ *  bitboard.h
+ *  performance_c
+ */
+
+#ifndef __BITBOARD_H__
+#define __BITBOARD_H__
+
+#include <stdint.h>
+#include "bitset.h"
+#include "board.h"
+
+/*
+ * Bitboard game states.
+ *
+ * An alternative to gamestate_t which represents the pegs on the board as a
+ * bitmask, with bit i set when the hole with index i (see coord_index()) is
+ * occupied. A bitboard_t is a small value: it is never allocated, and
+ * applying a move just returns a new one. Moves are identified by their
+ * jump id, the index of the jump in the board's jump table (see board.h),
+ * and legal moves come out in jump table order, which is the same order
+ * gamestate_legal_moves() produces them in.
+ *
+ * The pegs are a bitboard_bits_t of BITBOARD_WORDS 64-bit words (see
+ * bitset.h). The default of one word holds boards of up to 10 rows, as a
+ * plain uint64_t; build with -DBITBOARD_WORDS=n for bigger boards.
+ */
+
+#ifndef BITBOARD_WORDS
+#define BITBOARD_WORDS 1
+#endif
+
+#if BITBOARD_WORDS == 1
+DEFINE_BITSET_1(bitboard_bits)
+#else
+DEFINE_BITSET(bitboard_bits, BITBOARD_WORDS)
+#endif
+
+#define BITBOARD_MAX_HOLES (64 * BITBOARD_WORDS)
+
+// words of the legal move sets below; bitboard_bits_t is for holes
+typedef uint64_t bitboard_word_t;
+
+// the bits each jump in a board's jump table tests and changes
+typedef struct bitboard_jump {
+	bitboard_bits_t from;
+	bitboard_bits_t jumped;
+	bitboard_bits_t to;
+	uint64_t zobrist;  // the change the jump makes to a board's hash
+} bitboard_jump_t;
+
+// a board's jump masks, built once per board and never freed
+typedef struct bitboard_tables {
+	const bitboard_jump_t *jumps;  // indexed by jump id
+	
+	// the same jumps laid out for the legal move kernels: jump i is legal
+	// when (pegs & mask[i]) == need[i]. The arrays are padded to a multiple
+	// of BITBOARD_KERNEL_WIDTH with entries that never match.
+	int padded_count;
+	const bitboard_bits_t *need;  // from | jumped
+	const bitboard_bits_t *mask;  // from | jumped | to
+	
+	// how applying each jump changes a legal move set (see below): for jump
+	// id j, BITBOARD_LEGAL_UPDATES masks of legal_words words each, starting
+	// at legal_updates[j * BITBOARD_LEGAL_UPDATES * legal_words]
+	const bitboard_word_t *legal_updates;
+	int legal_words;  // how many words of a legal move set this board uses
+	
+	// the board's symmetries applied a byte of pegs at a time: symmetry s
+	// takes byte k of a board with value v to
+	// transforms[(s * transform_bytes + k) * 256 + v]
+	int transform_bytes;
+	const bitboard_bits_t *transforms;
+} bitboard_tables_t;
+
+#define BITBOARD_KERNEL_WIDTH 4
+
+// an n-row board has 3(n - 1)(n - 2) jumps, which is always under 6 per
+// hole; for one word, a 10-row board has 216
+#define BITBOARD_MAX_JUMPS (384 * BITBOARD_WORDS)
+#define BITBOARD_LEGAL_WORDS (BITBOARD_MAX_JUMPS / 64)
+
+typedef struct bitboard {
+	const board_t *board;
+	const bitboard_tables_t *tables;  // bitboard_tables(board)
+	bitboard_bits_t pegs;
+	uint64_t hash;  // Zobrist hash of pegs (see board.h)
+} bitboard_t;
+
+const bitboard_tables_t *bitboard_tables(const board_t *board);
+
+// a full board with only the hole at empty_hole left empty
+bitboard_t bitboard_new(int rows, coord_index_t empty_hole);
+
+// bb's hash worked out from its pegs, and a check that it matches the one
+// it has, which exits with an error if it doesn't. Building with
+// -DDEBUG_HASH checks the hash of every board bitboard_apply_move() returns.
+uint64_t bitboard_compute_hash(bitboard_t bb);
+void bitboard_check_hash(bitboard_t bb);
+
+// the hash is updated along with the pegs: the jump's precomputed key
+// stands for the keys of all three holes it touches
+static inline bitboard_t bitboard_apply_move(bitboard_t bb, int jump_id) {
+	const bitboard_jump_t *jump = &bb.tables->jumps[jump_id];
+	bb.pegs = bitboard_bits_andnot(bb.pegs, jump->from);
+	bb.pegs = bitboard_bits_andnot(bb.pegs, jump->jumped);
+	bb.pegs = bitboard_bits_or(bb.pegs, jump->to);
+	bb.hash ^= jump->zobrist;
+#ifdef DEBUG_HASH
+	bitboard_check_hash(bb);
+#endif
+	return bb;
+}
+
+static inline int bitboard_is_occupied(bitboard_t bb, coord_index_t idx) {
+	return bitboard_bits_test(bb.pegs, idx);
+}
+
+static inline int bitboard_pegs_remaining(bitboard_t bb) {
+	return bitboard_bits_popcount(bb.pegs);
+}
+
+// writes the ids of the jumps that are legal on bb into moves, which must
+// have room for board->jump_count of them, and returns how many there were
+int bitboard_legal_moves(bitboard_t bb, int *moves);
+
+/*
+ * Legal move kernels.
+ *
+ * bitboard_legal_moves() tests the jumps with one of several interchangeable
+ * kernels. The vector kernels test 2 (SSE4.1) or 4 (AVX2) jumps per
+ * instruction, and are only there for one-word bitboards. By default the fastest one the CPU supports is picked the
+ * first time it's needed; building with -DBITBOARD_NO_SIMD leaves only the
+ * scalar kernel.
+ */
+enum {
+	BITBOARD_KERNEL_SCALAR,
+	BITBOARD_KERNEL_SSE4,
+	BITBOARD_KERNEL_AVX2,
+	BITBOARD_KERNELS
+};
+
+const char *bitboard_kernel_name(int kernel);
+int bitboard_kernel_supported(int kernel);
+
+// the kernel bitboard_legal_moves() uses, and a way to override it. Selecting
+// an unsupported kernel is an error.
+int bitboard_kernel(void);
+void bitboard_select_kernel(int kernel);
+
+/*
+ * Symmetry.
+ *
+ * Boards that are rotations or reflections of each other (see board_t's
+ * symmetry tables) have identical game trees below them. The canonical form
+ * of a board is the least of its six transforms by bitboard_bits_cmp(), so
+ * two boards are symmetric exactly when their canonical forms are equal.
+ */
+
+// bb's pegs moved by board symmetry s
+static inline bitboard_bits_t bitboard_transform(bitboard_t bb, int s) {
+	const bitboard_tables_t *t = bb.tables;
+	const bitboard_bits_t *lut = t->transforms + s * t->transform_bytes * 256;
+	bitboard_bits_t result = bitboard_bits_zero();
+	for (int k = 0; k < t->transform_bytes; k++) {
+		result = bitboard_bits_or(result, lut[k * 256 + bitboard_bits_byte(bb.pegs, k)]);
+	}
+	return result;
+}
+
+bitboard_bits_t bitboard_canonical(bitboard_t bb);
+
+// sets bit s of the result for each symmetry s that leaves bb unchanged.
+// Bit 0, for the identity, is always set.
+int bitboard_stabilizer(bitboard_t bb);
+
+/*
+ * Incremental legal move sets.
+ *
+ * Instead of testing every jump at every node, a search can keep three sets
+ * of jump ids up to date as it goes: the jumps whose from hole is occupied,
+ * those whose jumped hole is occupied, and those whose to hole is empty. A
+ * jump is legal when it is in all three. Applying a jump empties two holes
+ * and fills one, so each set changes by the jumps that start at, pass over
+ * or land in those holes. The tables hold those changes as whole words, so
+ * no jump is ever tested on its own.
+ */
+typedef struct bitboard_legal_set {
+	bitboard_word_t from[BITBOARD_LEGAL_WORDS];    // bit i set when jump i's from hole is occupied
+	bitboard_word_t jumped[BITBOARD_LEGAL_WORDS];  // the same for its jumped hole
+	bitboard_word_t to[BITBOARD_LEGAL_WORDS];      // bit i set when jump i's to hole is empty
+} bitboard_legal_set_t;
+
+// the masks in bitboard_tables_t's legal_updates, in order: the jumps each
+// set loses and gains
+enum {
+	BITBOARD_FROM_CLEAR,
+	BITBOARD_FROM_SET,
+	BITBOARD_JUMPED_CLEAR,
+	BITBOARD_JUMPED_SET,
+	BITBOARD_TO_CLEAR,
+	BITBOARD_TO_SET,
+	BITBOARD_LEGAL_UPDATES
+};
+
+// fills set in for bb
+void bitboard_legal_set_init(bitboard_t bb, bitboard_legal_set_t *set);
+
+// sets next to set as it is once jump_id is applied. Only the words the
+// board uses are written. To undo the jump, go back to set.
+static inline void bitboard_legal_set_apply(const bitboard_tables_t *t, const bitboard_legal_set_t *set,
+											int jump_id, bitboard_legal_set_t *next) {
+	int words = t->legal_words;
+	const bitboard_word_t *u = t->legal_updates + jump_id * BITBOARD_LEGAL_UPDATES * words;
+	for (int w = 0; w < words; w++) {
+		next->from[w] = (set->from[w] & ~u[BITBOARD_FROM_CLEAR * words + w]) | u[BITBOARD_FROM_SET * words + w];
+		next->jumped[w] = (set->jumped[w] & ~u[BITBOARD_JUMPED_CLEAR * words + w]) | u[BITBOARD_JUMPED_SET * words + w];
+		next->to[w] = (set->to[w] & ~u[BITBOARD_TO_CLEAR * words + w]) | u[BITBOARD_TO_SET * words + w];
+	}
+}
+
+// writes the legal jump ids into moves in ascending order, like
+// bitboard_legal_moves(), and returns how many there were
+static inline int bitboard_legal_set_moves(const bitboard_tables_t *t, const bitboard_legal_set_t *set, int *moves) {
+	int count = 0;
+	for (int w = 0; w < t->legal_words; w++) {
+		bitboard_word_t bits = set->from[w] & set->jumped[w] & set->to[w];
+		while (bits) {
+			moves[count++] = w * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+		}
+	}
+	return count;
+}
+
+void bitboard_print(bitboard_t bb);
+
+#endif
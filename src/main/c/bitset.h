@@ -0,0 +1,146 @@
+/*
+ *  bitset.h
+ *  performance_c
+ */
+
+#ifndef __BITSET_H__
+#define __BITSET_H__
+
+#include <stdint.h>
+
+/*
+ * Fixed-width bitsets.
+ *
+ * DEFINE_BITSET(name, words) generates a value type name_t holding
+ * words * 64 bits, together with static inline operations on it:
+ *
+ *     name_zero()          the empty set
+ *     name_bit(i)          the set containing only bit i
+ *     name_or(a, b)        a | b
+ *     name_and(a, b)       a & b
+ *     name_andnot(a, b)    a & ~b
+ *     name_xor(a, b)       a ^ b
+ *     name_eq(a, b)        a == b
+ *     name_is_zero(a)      a == 0
+ *     name_test(a, i)      bit i of a
+ *     name_popcount(a)     number of bits set
+ *     name_byte(a, k)      bits 8k to 8k + 7 of a, as an int
+ *     name_cmp(&a, &b)     a total order, usable with typed_list.h
+ *     name_hash(a)         a 64-bit mix of all the words
+ *
+ * The word loops have constant bounds, so the compiler unrolls them.
+ * DEFINE_BITSET_1(name) generates the same API for the one-word case on a
+ * plain uint64_t, so that code written against the API compiles to
+ * single instructions there.
+ */
+
+#define DEFINE_BITSET(name, words)                                                  \
+                                                                                    \
+typedef struct name {                                                               \
+	uint64_t w[words];                                                              \
+} name##_t;                                                                         \
+                                                                                    \
+enum { name##_words = words };                                                      \
+                                                                                    \
+static inline name##_t name##_zero(void) {                                          \
+	name##_t r;                                                                     \
+	for (int k = 0; k < words; k++) r.w[k] = 0;                                     \
+	return r;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_t name##_bit(int i) {                                          \
+	name##_t r = name##_zero();                                                     \
+	r.w[i >> 6] = (uint64_t) 1 << (i & 63);                                         \
+	return r;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_t name##_or(name##_t a, name##_t b) {                          \
+	for (int k = 0; k < words; k++) a.w[k] |= b.w[k];                               \
+	return a;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_t name##_and(name##_t a, name##_t b) {                         \
+	for (int k = 0; k < words; k++) a.w[k] &= b.w[k];                               \
+	return a;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_t name##_andnot(name##_t a, name##_t b) {                      \
+	for (int k = 0; k < words; k++) a.w[k] &= ~b.w[k];                              \
+	return a;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_t name##_xor(name##_t a, name##_t b) {                         \
+	for (int k = 0; k < words; k++) a.w[k] ^= b.w[k];                               \
+	return a;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline int name##_eq(name##_t a, name##_t b) {                               \
+	uint64_t diff = 0;                                                              \
+	for (int k = 0; k < words; k++) diff |= a.w[k] ^ b.w[k];                        \
+	return diff == 0;                                                               \
+}                                                                                   \
+                                                                                    \
+static inline int name##_is_zero(name##_t a) {                                      \
+	uint64_t any = 0;                                                               \
+	for (int k = 0; k < words; k++) any |= a.w[k];                                  \
+	return any == 0;                                                                \
+}                                                                                   \
+                                                                                    \
+static inline int name##_test(name##_t a, int i) {                                  \
+	return (a.w[i >> 6] >> (i & 63)) & 1;                                           \
+}                                                                                   \
+                                                                                    \
+static inline int name##_popcount(name##_t a) {                                     \
+	int n = 0;                                                                      \
+	for (int k = 0; k < words; k++) n += __builtin_popcountll(a.w[k]);              \
+	return n;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline int name##_byte(name##_t a, int k) {                                 \
+	return (a.w[k >> 3] >> ((k & 7) * 8)) & 0xff;                                   \
+}                                                                                   \
+                                                                                    \
+static inline int name##_cmp(const name##_t *a, const name##_t *b) {                \
+	for (int k = words - 1; k >= 0; k--) {                                          \
+		if (a->w[k] != b->w[k]) return a->w[k] < b->w[k] ? -1 : 1;                  \
+	}                                                                               \
+	return 0;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline uint64_t name##_hash(name##_t a) {                                    \
+	uint64_t h = 0;                                                                 \
+	for (int k = 0; k < words; k++) {                                               \
+		h = (h ^ a.w[k]) * 0x9E3779B97F4A7C15ull;                                   \
+		h ^= h >> 29;                                                               \
+	}                                                                               \
+	return h;                                                                       \
+}
+
+#define DEFINE_BITSET_1(name)                                                       \
+                                                                                    \
+typedef uint64_t name##_t;                                                          \
+                                                                                    \
+enum { name##_words = 1 };                                                          \
+                                                                                    \
+static inline name##_t name##_zero(void) { return 0; }                              \
+static inline name##_t name##_bit(int i) { return (uint64_t) 1 << i; }              \
+static inline name##_t name##_or(name##_t a, name##_t b) { return a | b; }          \
+static inline name##_t name##_and(name##_t a, name##_t b) { return a & b; }         \
+static inline name##_t name##_andnot(name##_t a, name##_t b) { return a & ~b; }     \
+static inline name##_t name##_xor(name##_t a, name##_t b) { return a ^ b; }         \
+static inline int name##_eq(name##_t a, name##_t b) { return a == b; }              \
+static inline int name##_is_zero(name##_t a) { return a == 0; }                     \
+static inline int name##_test(name##_t a, int i) { return (a >> i) & 1; }           \
+static inline int name##_popcount(name##_t a) { return __builtin_popcountll(a); }   \
+static inline int name##_byte(name##_t a, int k) { return (a >> (k * 8)) & 0xff; }  \
+                                                                                    \
+static inline int name##_cmp(const name##_t *a, const name##_t *b) {                \
+	return (*a > *b) - (*a < *b);                                                   \
+}                                                                                   \
+                                                                                    \
+static inline uint64_t name##_hash(name##_t a) {                                    \
+	uint64_t h = a * 0x9E3779B97F4A7C15ull;                                         \
+	return h ^ (h >> 29);                                                           \
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  board.c
+ *  performance_c
+ */
+
+#include "board.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// boards built so far, indexed by row count
+static board_t **boards = NULL;
+static int board_count = 0;
+
+// the Zobrist key of hole h: splitmix64 of h, so the keys are fixed
+static uint64_t zobrist_key(coord_index_t h) {
+	uint64_t z = (uint64_t) (h + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static board_t *board_new(int rowcount) {
+	board_t *b = mem_alloc_immortal(sizeof(board_t), "board");
+	b->rowcount = rowcount;
+	b->hole_count = (rowcount * (rowcount + 1)) / 2;
+	b->jump_count = 0;
+	
+	// before any search threads can start looking coordinates up
+	coord_intern(rowcount);
+	
+	b->zobrist = mem_alloc_immortal(sizeof(uint64_t) * b->hole_count, "board_jumps");
+	for (coord_index_t h = 0; h < b->hole_count; h++) {
+		b->zobrist[h] = zobrist_key(h);
+	}
+	
+	// no hole has more than one jump out of it in each direction
+	b->jumps = mem_alloc_immortal(sizeof(board_jump_t) * COORD_DIRECTIONS * b->hole_count, "board_jumps");
+	b->first_jump = mem_alloc_immortal(sizeof(int) * (b->hole_count + 1), "board_jumps");
+	
+	for (coord_index_t from = 0; from < b->hole_count; from++) {
+		b->first_jump[from] = b->jump_count;
+		for (int dir = 0; dir < COORD_DIRECTIONS; dir++) {
+			coord_index_t jumped = coord_index_neighbour(from, dir, rowcount);
+			coord_index_t to = jumped < 0 ? -1 : coord_index_neighbour(jumped, dir, rowcount);
+			if (to < 0) {
+				continue;
+			}
+			
+			board_jump_t *j = &b->jumps[b->jump_count++];
+			j->from = from;
+			j->jumped = jumped;
+			j->to = to;
+			j->packed = move_pack(from, jumped, to);
+			j->zobrist = b->zobrist[from] ^ b->zobrist[jumped] ^ b->zobrist[to];
+			
+			j->move = mem_alloc_immortal(sizeof(move_t), "move");
+			j->move->from = coord_at_index(from);
+			j->move->jumped = coord_at_index(jumped);
+			j->move->to = coord_at_index(to);
+		}
+	}
+	b->first_jump[b->hole_count] = b->jump_count;
+	
+	// In barycentric terms, hole (row, hole) is a = row - hole, b = hole - 1,
+	// c = rowcount - row, with a + b + c = rowcount - 1; the symmetries are
+	// the six ways of permuting a, b and c.
+	static const int permutations[BOARD_SYMMETRIES][3] = {
+		{ 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 },  // rotations
+		{ 1, 0, 2 }, { 0, 2, 1 }, { 2, 1, 0 }   // reflections
+	};
+	b->symmetry = mem_alloc_immortal(sizeof(coord_index_t) * BOARD_SYMMETRIES * b->hole_count, "board_jumps");
+	for (int s = 0; s < BOARD_SYMMETRIES; s++) {
+		for (coord_index_t h = 0; h < b->hole_count; h++) {
+			int row = coord_index_row(h);
+			int hole = coord_index_hole(h);
+			int abc[3] = { row - hole, hole - 1, rowcount - row };
+			int a = abc[permutations[s][0]];
+			int bb = abc[permutations[s][1]];
+			b->symmetry[s * b->hole_count + h] = coord_index(a + bb + 1, bb + 1);
+		}
+	}
+	
+	return b;
+}
+
+const board_t *board_get(int rowcount) {
+	if (rowcount >= board_count) {
+		board_t **new_boards = realloc(boards, sizeof(board_t *) * (rowcount + 1));
+		if (new_boards == NULL) {
+			perror("Failed to grow the board table");
+			exit(1);
+		}
+		for (int i = board_count; i <= rowcount; i++) {
+			new_boards[i] = NULL;
+		}
+		boards = new_boards;
+		board_count = rowcount + 1;
+	}
+	
+	if (boards[rowcount] == NULL) {
+		boards[rowcount] = board_new(rowcount);
+	}
+	return boards[rowcount];
+}
@@ -0,0 +1,65 @@
+/*
+ *  board.h
+ *  performance_c
+ */
+
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include <stdint.h>
+#include "move.h"
+
+/*
+ * Board topology.
+ *
+ * A board_t describes everything about a triangular board that doesn't
+ * depend on which holes are occupied: its holes, and every jump that is
+ * geometrically possible on it. It is built once per row count and shared
+ * from then on, so move generation only has to look jumps up rather than
+ * construct them.
+ *
+ * Holes are identified by their hole indices (see coord_index()), so they
+ * are numbered from 0 to hole_count - 1.
+ */
+
+typedef struct board_jump {
+	coord_index_t from;
+	coord_index_t jumped;
+	coord_index_t to;
+	move_t *move;  // the same jump as an immortal move_t of interned coordinates
+	packed_move_t packed;
+	uint64_t zobrist;  // the Zobrist keys of from, jumped and to XORed together
+} board_jump_t;
+
+typedef struct board {
+	int rowcount;
+	int hole_count;
+	
+	// every possible jump, grouped by origin hole: the jumps out of hole h
+	// are jumps[first_jump[h]] up to (but not including) jumps[first_jump[h + 1]]
+	int jump_count;
+	board_jump_t *jumps;
+	int *first_jump;
+	
+	// the board's six symmetries (the dihedral group D3): symmetry s takes
+	// hole h to hole symmetry[s * hole_count + h]. Symmetry 0 is the identity.
+	coord_index_t *symmetry;
+	
+	// a random key per hole for Zobrist hashing: the hash of a position is
+	// the XOR of the keys of its occupied holes, so a jump changes it by
+	// XORing in the keys of the three holes it touches. A hole has the same
+	// key on every board, and the keys are the same from run to run.
+	uint64_t *zobrist;
+} board_t;
+
+#define BOARD_SYMMETRIES 6
+
+/*
+ * Returns the shared, immortal board with the given number of rows,
+ * building it the first time it's asked for. Building a board interns the
+ * coordinates of all its holes (see coord_at()). Not thread-safe; get the
+ * board before starting any threads that use it.
+ */
+const board_t *board_get(int rowcount);
+
+#endif
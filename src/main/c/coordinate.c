@@ -35,7 +35,6 @@
 #include "memory.h"
 #include "coordinate.h"
 #include "alist.h"
-#include "move.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -54,84 +53,71 @@ coord_t *coord_new(int row, int hole) {
 	return c;
 }
 
-alist_t *coord_possible_moves(coord_t *c, int rowCount) {
-	alist_t *moves = alist_new();
-	
-	move_t *tmp = NULL;
-	
-	// upward (needs at least 2 rows above)
-	if (c->row >= 3) {
-		
-		// up-left
-		if (c->hole >= 3) {
-			alist_add(moves, tmp = move_new(
-							   c,
-							   coord_new(c->row - 1, c->hole - 1),
-							   coord_new(c->row - 2, c->hole - 2)));
-			mem_release(tmp->jumped);
-			mem_release(tmp->to);
-			mem_release(tmp);
-		}
-		
-		// up-right
-		if (c->row - c->hole >= 2) {
-			alist_add(moves, tmp = move_new(
-							   c,
-							   coord_new(c->row - 1, c->hole),
-							   coord_new(c->row - 2, c->hole)));
-			mem_release(tmp->jumped);
-			mem_release(tmp->to);
-			mem_release(tmp);
-		}
+// interned coordinates, indexed by hole index
+static coord_t **interned = NULL;
+static int interned_count = 0;
+
+void coord_intern(int rowcount) {
+	int count = coord_index(rowcount + 1, 1);
+	if (count <= interned_count) {
+		return;
 	}
 	
-	// leftward (needs at least 2 pegs to the left)
-	if (c->hole >= 3) {
-		alist_add(moves, tmp = move_new(
-						   c,
-						   coord_new(c->row, c->hole - 1),
-						   coord_new(c->row, c->hole - 2)));
-		mem_release(tmp->jumped);
-		mem_release(tmp->to);
-		mem_release(tmp);
+	coord_t **new_interned = realloc(interned, sizeof(coord_t *) * count);
+	if (new_interned == NULL) {
+		perror("Failed to grow the interned coordinate table");
+		exit(1);
 	}
-	
-	// rightward (needs at least 2 holes to the right)
-	if (c->row - c->hole >= 2) {
-		alist_add(moves, tmp = move_new(
-						   c,
-						   coord_new(c->row, c->hole + 1),
-						   coord_new(c->row, c->hole + 2)));
-		mem_release(tmp->jumped);
-		mem_release(tmp->to);
-		mem_release(tmp);
+	for (coord_index_t idx = interned_count; idx < count; idx++) {
+		coord_t *c = mem_alloc_immortal(sizeof(coord_t), "coord");
+		c->row = coord_index_row(idx);
+		c->hole = coord_index_hole(idx);
+		new_interned[idx] = c;
 	}
-	
-	// downward (needs at least 2 rows below)
-	if (rowCount - c->row >= 2) {
-		
-		// down-left (always possible when there are at least 2 rows below)
-		alist_add(moves, tmp = move_new(
-						   c,
-						   coord_new(c->row + 1, c->hole),
-						   coord_new(c->row + 2, c->hole)));
-		mem_release(tmp->jumped);
-		mem_release(tmp->to);
-		mem_release(tmp);
+	interned = new_interned;
+	interned_count = count;
+}
+
+coord_t *coord_at(int row, int hole) {
+	return coord_at_index(coord_index(row, hole));
+}
 
-		// down-right (always possible when there are at least 2 rows below)
-		alist_add(moves, tmp = move_new(
-						   c,
-						   coord_new(c->row + 1, c->hole + 1),
-						   coord_new(c->row + 2, c->hole + 2)));
-		mem_release(tmp->jumped);
-		mem_release(tmp->to);
-		mem_release(tmp);
+coord_t *coord_at_index(coord_index_t idx) {
+	if (idx >= interned_count) {
+		coord_intern(coord_index_row(idx));
 	}
-	
-	return moves;
+	return interned[idx];
 }
 
+int coord_index_row(coord_index_t idx) {
+	int row = 1;
+	while (coord_index(row + 1, 1) <= idx) {
+		row++;
+	}
+	return row;
+}
+
+int coord_index_hole(coord_index_t idx) {
+	int row = coord_index_row(idx);
+	return idx - coord_index(row, 1) + 1;
+}
+
+// row and hole offsets for each direction
+static const int direction_rows[COORD_DIRECTIONS]  = { -1, -1,  0, 0, 1, 1 };
+static const int direction_holes[COORD_DIRECTIONS] = { -1,  0, -1, 1, 0, 1 };
+
+coord_index_t coord_index_neighbour(coord_index_t idx, int direction, int rowcount) {
+	int row = coord_index_row(idx) + direction_rows[direction];
+	int hole = coord_index_hole(idx) + direction_holes[direction];
+	if (row < 1 || row > rowcount || hole < 1 || hole > row) {
+		return -1;
+	}
+	return coord_index(row, hole);
+}
+
+void coord_index_print(coord_index_t idx) {
+	printf("r%dh%d", coord_index_row(idx), coord_index_hole(idx));
+}
 
 int coord_cmp(coord_t *lhs, coord_t *rhs) {
 	//printf("Compare coord r%dh%d to r%dh%d: ", lhs->row, lhs->hole, rhs->row, rhs->hole);
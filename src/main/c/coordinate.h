@@ -38,6 +38,7 @@
 #define __COORDINATE_H__
 
 #include "alist.h"
+#include "typed_list.h"
 
 typedef struct coord {
 	int row;
@@ -46,14 +47,81 @@ typedef struct coord {
 
 coord_t *coord_new(int row, int hole);
 
+/*
+ * Returns the shared, immortal coordinate for the given row and hole.
+ * Calling this twice with the same arguments returns the same pointer.
+ * Retaining and releasing the result is allowed but costs nothing, so
+ * code that only ever deals in interned coordinates needn't bother.
+ *
+ * The coordinates are made by coord_intern(), or the first time a hole in
+ * their row is asked for, and making them isn't thread-safe. Once they are
+ * made, looking them up is: board_get() interns every hole of the board it
+ * builds, so the holes of a board can be looked up from any thread.
+ */
+coord_t *coord_at(int row, int hole);
+
+// interns the coordinates of every hole in the first rowcount rows, if they
+// weren't already. Not thread-safe.
+void coord_intern(int rowcount);
+
 int coord_cmp(coord_t *lhs, coord_t *rhs);
 
 /*
- * Returns a list of move_t which enumerates the possible moves from
- * this coordinate. The caller is responsible for freeing both the
- * returned list and all the items in it.
+ * Hole indices.
+ *
+ * Every hole on a triangular board has a small integer index, counting from
+ * 0 at the top of the board in row-major order, so hole h of row r has index
+ * (r * (r - 1)) / 2 + h - 1. The index of a hole doesn't depend on how many
+ * rows the board has, and index order is the same as coord_cmp() order.
+ * Indices are plain values: they are never allocated or reference counted.
  */
-alist_t *coord_possible_moves(coord_t *c, int rowCount);
+typedef int coord_index_t;
+
+// the six directions a peg can jump in; see coord_index_neighbour()
+enum {
+	COORD_UP_LEFT,
+	COORD_UP_RIGHT,
+	COORD_LEFT,
+	COORD_RIGHT,
+	COORD_DOWN_LEFT,
+	COORD_DOWN_RIGHT,
+	COORD_DIRECTIONS
+};
+
+static inline coord_index_t coord_index(int row, int hole) {
+	return (row * (row - 1)) / 2 + hole - 1;
+}
+
+static inline coord_index_t coord_index_of(const coord_t *c) {
+	return coord_index(c->row, c->hole);
+}
+
+int coord_index_row(coord_index_t idx);
+int coord_index_hole(coord_index_t idx);
+
+// the interned coordinate for the hole at idx (see coord_at())
+coord_t *coord_at_index(coord_index_t idx);
+
+// returns the index of the hole next to idx in the given direction, or -1
+// if that would be off a board with rowcount rows
+coord_index_t coord_index_neighbour(coord_index_t idx, int direction, int rowcount);
+
+// prints the hole as rNhN, the way move_print() prints coordinates
+void coord_index_print(coord_index_t idx);
+
+// same ordering as coord_cmp(), for comparing coordinates stored by value
+static inline int coord_value_cmp(const coord_t *lhs, const coord_t *rhs) {
+	if (lhs->row != rhs->row) {
+		return lhs->row < rhs->row ? -1 : 1;
+	}
+	if (lhs->hole != rhs->hole) {
+		return lhs->hole < rhs->hole ? -1 : 1;
+	}
+	return 0;
+}
+
+// coord_list_t: a list of coordinates stored by value (see typed_list.h)
+DEFINE_TYPED_LIST(coord_list, coord_t, coord_value_cmp)
 
 #endif
 
@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "alist.h"
+#include "sset.h"
 #include "gamestate.h"
 #include "coordinate.h"
 
@@ -45,87 +46,184 @@ static void gamestate_free(gamestate_t *gs) {
 	mem_release(gs->occupied_holes);
 }
 
+// the change move makes to a state's hash
+static uint64_t move_hash(const board_t *b, move_t *move) {
+	return b->zobrist[coord_index_of(move->from)] ^
+		   b->zobrist[coord_index_of(move->jumped)] ^
+		   b->zobrist[coord_index_of(move->to)];
+}
+
 gamestate_t *gamestate_new(int rows, coord_t *empty_hole) {
 	gamestate_t *gs = mem_alloc(sizeof(gamestate_t), (void (*)(void*)) gamestate_free, "gamestate");
 	
 	gs->rowcount = rows;
+	gs->board = board_get(rows);
 	gs->occupied_holes = alist_new();
 	
-	for (int row = 1; row <= rows; row++) {
-		for (int hole = 1; hole <= row; hole++) {
-			coord_t *peg = coord_new(row, hole);
-			if (coord_cmp(peg, empty_hole) != 0) {
-				alist_add(gs->occupied_holes, peg);
-			}
-			mem_release(peg);
+	coord_index_t empty = coord_index_of(empty_hole);
+	for (coord_index_t idx = 0; idx < gs->board->hole_count; idx++) {
+		if (idx != empty) {
+			alist_add(gs->occupied_holes, coord_at_index(idx));  // index order is sorted
 		}
 	}
+	gs->hash = gamestate_compute_hash(gs);
 	
 	return gs;
 }
 
-gamestate_t *gamestate_apply_move(gamestate_t *gs, move_t *move) {
-	gamestate_t *newgs = mem_alloc(sizeof(gamestate_t), (void (*)(void*)) gamestate_free, "gamestate");
-	if (gs == NULL) {
-		perror("Couldn't allocate game state");
-		exit(1);
+// in_region says whether the new state and its peg list are allocated
+// from the allocation region rather than the heap
+static gamestate_t *apply_move(gamestate_t *gs, move_t *move, int in_region) {
+	gamestate_t *newgs;
+	if (in_region) {
+		newgs = mem_region_alloc(sizeof(gamestate_t), (void (*)(void*)) gamestate_free, "gamestate");
+		newgs->occupied_holes = alist_new_copy_in_region(gs->occupied_holes);
+	} else {
+		newgs = mem_alloc(sizeof(gamestate_t), (void (*)(void*)) gamestate_free, "gamestate");
+		newgs->occupied_holes = alist_new_copy(gs->occupied_holes);
 	}
 	
 	newgs->rowcount = gs->rowcount;
-	newgs->occupied_holes = alist_new_copy(gs->occupied_holes);
+	newgs->board = gs->board;
 	
 //	printf("Copied game state:\n");
 //	gamestate_print(newgs);
 
 	
-	if (!alist_remove(newgs->occupied_holes, move->from, (int (*)(void*, void*)) coord_cmp)) {
-		printf("Move is not consistent with game state: 'from' hole was unoccupied.\n");
+	if (sset_contains(gs->occupied_holes, move->to, (int (*)(void*, void*)) coord_cmp)) {
+		printf("Move is not consistent with game state: 'to' hole was occupied.\n");
 		exit(1);
 	}
-//	printf("index of jumped hole in list: %d\n",
-//		   alist_index_of(newgs->occupied_holes, move->jumped, coord_cmp));
-	if (!alist_remove(newgs->occupied_holes, move->jumped, (int (*)(void*, void*)) coord_cmp)) {
+	if (move->to->row > newgs->rowcount || move->to->row < 1) {
+		printf("Move is not legal because the 'to' hole does not exist: row %d, hole %d\n",
+			   move->to->row, move->to->hole);
+	}
+	
+	void *jump[2] = { move->from, move->jumped };
+	if (sset_replace(newgs->occupied_holes, jump, 2, move->to, (int (*)(void*, void*)) coord_cmp) != 2) {
+		if (!sset_contains(gs->occupied_holes, move->from, (int (*)(void*, void*)) coord_cmp)) {
+			printf("Move is not consistent with game state: 'from' hole was unoccupied.\n");
+			exit(1);
+		}
 		printf("Move is not consistent with game state: jumped hole was unoccupied.\n");
 		printf("Old game state:\n");
 		gamestate_print(gs);
 		printf("Attempted move: ");
 		move_print(move);
-		printf("New game state ('from' hole should now be empty):\n");
-		gamestate_print(newgs);
 		exit(1);
 	}
-	if (alist_contains(newgs->occupied_holes, move->to,(int (*)(void*, void*))  coord_cmp)) {
-		printf("Move is not consistent with game state: 'to' hole was occupied.\n");
+	newgs->hash = gs->hash ^ move_hash(gs->board, move);
+#ifdef DEBUG_HASH
+	gamestate_check_hash(newgs);
+#endif
+	
+	return newgs;
+}
+
+gamestate_t *gamestate_apply_move(gamestate_t *gs, move_t *move) {
+	return apply_move(gs, move, 0);
+}
+
+gamestate_t *gamestate_apply_move_in_region(gamestate_t *gs, move_t *move) {
+	return apply_move(gs, move, 1);
+}
+
+void gamestate_make_move(gamestate_t *gs, move_t *move) {
+	void *jump[2] = { move->from, move->jumped };
+	if (sset_contains(gs->occupied_holes, move->to, (int (*)(void*, void*)) coord_cmp) ||
+		sset_replace(gs->occupied_holes, jump, 2, move->to, (int (*)(void*, void*)) coord_cmp) != 2) {
+		printf("Move is not consistent with game state: ");
+		move_print(move);
 		exit(1);
 	}
-	if (move->to->row > newgs->rowcount || move->to->row < 1) {
-		printf("Move is not legal because the 'to' hole does not exist: row %d, hole %d\n",
-			   move->to->row, move->to->hole);
+	gs->hash ^= move_hash(gs->board, move);
+#ifdef DEBUG_HASH
+	gamestate_check_hash(gs);
+#endif
+}
+
+void gamestate_unmake_move(gamestate_t *gs, move_t *move) {
+	if (!sset_remove(gs->occupied_holes, move->to, (int (*)(void*, void*)) coord_cmp)) {
+		printf("Move can't be unmade: 'to' hole is unoccupied: ");
+		move_print(move);
+		exit(1);
 	}
-	alist_add(newgs->occupied_holes, move->to);
+	sset_insert(gs->occupied_holes, move->jumped, (int (*)(void*, void*)) coord_cmp);
+	sset_insert(gs->occupied_holes, move->from, (int (*)(void*, void*)) coord_cmp);
+	gs->hash ^= move_hash(gs->board, move);
+#ifdef DEBUG_HASH
+	gamestate_check_hash(gs);
+#endif
+}
+
+int gamestate_legal_moves_into(gamestate_t *gs, move_list_t *moves, coord_list_t *pegs) {
+	const board_t *b = gs->board;
 	
-	return newgs;
+	// the occupied holes are a sorted set, so the copy is sorted too
+	coord_list_clear(pegs);
+	for (int i = 0; i < gs->occupied_holes->size; i++) {
+		coord_list_add(pegs, *(coord_t *) gs->occupied_holes->entries[i]);
+	}
+	
+	move_list_clear(moves);
+	for (int i = 0; i < pegs->size; i++) {
+		int h = coord_index_of(&pegs->entries[i]);
+		for (int j = b->first_jump[h]; j < b->first_jump[h + 1]; j++) {
+			move_t *m = b->jumps[j].move;
+			if (coord_list_sorted_index_of(pegs, m->jumped) >= 0 &&
+				coord_list_sorted_index_of(pegs, m->to) < 0) {
+				move_list_add(moves, *m);
+			}
+		}
+	}
+	return moves->size;
 }
 
-alist_t *gamestate_legal_moves(gamestate_t *gs) {
-	alist_t *legalMoves = alist_new();
+// The reference engine's lists hold the board's immortal moves themselves,
+// so they needn't be retained.
+static alist_t *legal_moves(gamestate_t *gs, alist_t *legalMoves) {
+	const board_t *b = gs->board;
 	for (int i = 0; i < gs->occupied_holes->size; i++) {
-		coord_t *c = alist_get(gs->occupied_holes, i);
+		coord_t *c = gs->occupied_holes->entries[i];
+		int h = coord_index_of(c);
 		
-		alist_t *possibleMoves = coord_possible_moves(c, gs->rowcount);
-		for (int j = 0; j < possibleMoves->size; j++) {
-			move_t *m = alist_get(possibleMoves, j);
-			if (alist_contains(gs->occupied_holes, m->jumped, (int (*)(void*, void*)) coord_cmp) &&
-				!alist_contains(gs->occupied_holes, m->to, (int (*)(void*, void*)) coord_cmp)) {
+		for (int j = b->first_jump[h]; j < b->first_jump[h + 1]; j++) {
+			move_t *m = b->jumps[j].move;
+			if (sset_contains(gs->occupied_holes, m->jumped, (int (*)(void*, void*)) coord_cmp) &&
+				!sset_contains(gs->occupied_holes, m->to, (int (*)(void*, void*)) coord_cmp)) {
 				alist_add(legalMoves, m);
 			}
 		}
-		
-		mem_release(possibleMoves);
 	}
 	return legalMoves;
 }
 
+alist_t *gamestate_legal_moves(gamestate_t *gs) {
+	return legal_moves(gs, alist_new());
+}
+
+alist_t *gamestate_legal_moves_in_region(gamestate_t *gs) {
+	return legal_moves(gs, alist_new_in_region());
+}
+
+uint64_t gamestate_compute_hash(gamestate_t *gs) {
+	uint64_t hash = 0;
+	for (int i = 0; i < gs->occupied_holes->size; i++) {
+		hash ^= gs->board->zobrist[coord_index_of(gs->occupied_holes->entries[i])];
+	}
+	return hash;
+}
+
+void gamestate_check_hash(gamestate_t *gs) {
+	uint64_t expected = gamestate_compute_hash(gs);
+	if (gs->hash != expected) {
+		printf("Game state hash is %016llx, but its pegs hash to %016llx:\n",
+			   (unsigned long long) gs->hash, (unsigned long long) expected);
+		gamestate_print(gs);
+		exit(1);
+	}
+}
+
 int gamestate_pegs_remaining(gamestate_t *gs) {
 	return gs->occupied_holes->size;
 }
@@ -138,13 +236,12 @@ void gamestate_print(gamestate_t *gs) {
 			printf(" ");
 		}
 		for (int hole = 1; hole <= row; hole++) {
-			coord_t *this_coord = coord_new(row, hole);
-			if (alist_contains(gs->occupied_holes, this_coord, (int (*)(void*, void*)) coord_cmp)) {
+			coord_t *this_coord = coord_at(row, hole);
+			if (sset_contains(gs->occupied_holes, this_coord, (int (*)(void*, void*)) coord_cmp)) {
 				printf(" *");
 			} else {
 				printf(" O");
 			}
-			mem_release(this_coord);
 		}
 		printf("\n");
 	}
@@ -37,19 +37,54 @@
 #ifndef __GAMESTATE_H__
 #define __GAMESTATE_H__
 
+#include <stdint.h>
 #include "alist.h"
 #include "coordinate.h"
 #include "move.h"
+#include "board.h"
 
 typedef struct gamestate {
 	int rowcount;
-	alist_t *occupied_holes;
+	const board_t *board;
+	alist_t *occupied_holes;  // sorted set of coord_t (see sset.h)
+	uint64_t hash;            // Zobrist hash of occupied_holes (see board.h)
 } gamestate_t;
 
 gamestate_t *gamestate_new(int rows, coord_t *empty_hole);
 
 gamestate_t *gamestate_apply_move(gamestate_t *gs, move_t *move);
 alist_t *gamestate_legal_moves(gamestate_t *gs);
+
+// Same as gamestate_apply_move() and gamestate_legal_moves(), except the
+// returned state or list is allocated from the allocation region. The caller
+// may either release it or just reset the region to a mark taken before the
+// call (see mem_region_mark()).
+gamestate_t *gamestate_apply_move_in_region(gamestate_t *gs, move_t *move);
+alist_t *gamestate_legal_moves_in_region(gamestate_t *gs);
+
+// applies move to gs in place, and reverts it again. Unmaking the moves
+// made on a state, most recent first, leaves it exactly as it was. Neither
+// allocates anything once the state has its own peg list.
+void gamestate_make_move(gamestate_t *gs, move_t *move);
+void gamestate_unmake_move(gamestate_t *gs, move_t *move);
+
+// replaces the contents of moves with copies of the legal moves, and
+// returns how many there were. pegs is scratch space the state's pegs are
+// copied into by value first, so that looking holes up among them calls
+// coord_value_cmp() inline instead of coord_cmp() through a pointer. Once
+// the two lists have grown to fit, this allocates nothing.
+int gamestate_legal_moves_into(gamestate_t *gs, move_list_t *moves, coord_list_t *pegs);
+
+// Zobrist hashing.
+//
+// Every way of changing a state updates its hash with three XORs, one per
+// hole the jump touches, so it costs next to nothing to keep. These work
+// it out from scratch instead, and exit with an error if it doesn't match
+// the state's hash. Building with -DDEBUG_HASH checks the hash after
+// every change.
+uint64_t gamestate_compute_hash(gamestate_t *gs);
+void gamestate_check_hash(gamestate_t *gs);
+
 int gamestate_pegs_remaining(gamestate_t *gs);
 void gamestate_print(gamestate_t *gs);
 
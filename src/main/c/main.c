@@ -31,54 +31,473 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "memory.h"
 #include "alist.h"
 #include "coordinate.h"
+#include "board.h"
+#include "bitboard.h"
 #include "gamestate.h"
+#include "memo.h"
+#include "move.h"
+#include "pagoda.h"
+#include "ttable.h"
 
 long gamesPlayed;
 
-// list contains lists which contain move_t*
-static alist_t *solutions;
+// a solution kept in solutionMoves
+typedef struct kept_solution {
+	int first;    // the index of its first move
+	int length;   // how many moves it has
+	long weight;  // how many solutions it stands for (see search_symmetric())
+} kept_solution_t;
+
+static inline int kept_solution_cmp(const kept_solution_t *lhs, const kept_solution_t *rhs) {
+	return lhs->first - rhs->first;
+}
+
+DEFINE_TYPED_LIST(kept_solution_list, kept_solution_t, kept_solution_cmp)
+
+// the first MAX_KEPT_SOLUTIONS solutions found, with their moves one after
+// another in solutionMoves. Bigger boards have far too many solutions to keep
+// them all; the rest are only counted, in solutionsDropped.
+#define MAX_KEPT_SOLUTIONS 100000
+static kept_solution_list_t solutions;
+static packed_move_list_t solutionMoves;
+static long solutionCount;
+static long solutionsDropped;
+
+// positions the pruned search expanded, and those it proved unsolvable
+static long nodesSearched;
+static long nodesPruned;
+static int pagodasChecked;
 
 static struct timeval startTime;
 static struct timeval endTime;
 
-static void search(gamestate_t *gs, alist_t *moveStack) {
+// which game state representation the search runs on
+enum engine {
+	ENGINE_REFERENCE,   // gamestate_t
+	ENGINE_BITBOARD,    // bitboard_t
+	ENGINE_INCREMENTAL, // bitboard_t with an incrementally updated legal move set
+	ENGINE_IN_PLACE,    // one gamestate_t, changed with make/unmake move
+	ENGINE_SYMMETRIC,   // bitboard_t, expanding symmetric siblings once
+	ENGINE_COUNTING,    // bitboard_t, counting each position's games once
+	ENGINE_PARALLEL,    // bitboard_t, counting on several threads sharing a table
+	ENGINE_PRUNED       // bitboard_t, only finding solutions, with pagoda pruning
+};
+static enum engine engine = ENGINE_REFERENCE;
+
+static int benchmarkKernels = 0;
+
+// settings for the parallel engine
+static int threadCount = 1;
+static long tableSize = 1L << 20;  // transposition table entries
+
+// the board to solve, and the hole left empty at the start
+static int rows = 5;
+static int emptyRow = 3;
+static int emptyHole = 2;
+
+// the hole the pruned engine's solutions have to end in; targetRow is 0
+// when none was given
+static int targetRow = 0;
+static int targetHole = 0;
+
+// records a solution that stands for weight solutions in all (see
+// search_symmetric())
+static void add_weighted_solution(const packed_move_t *moves, int count, long weight) {
+	if (solutions.size < MAX_KEPT_SOLUTIONS) {
+		kept_solution_t kept = { solutionMoves.size, count, weight };
+		kept_solution_list_add(&solutions, kept);
+		for (int i = 0; i < count; i++) {
+			packed_move_list_add(&solutionMoves, moves[i]);
+		}
+	} else {
+		solutionsDropped += weight;
+	}
+	solutionCount += weight;
+}
+
+static void add_solution(const packed_move_t *moves, int count) {
+	add_weighted_solution(moves, count, 1);
+}
+
+static void search(gamestate_t *gs, packed_move_list_t *moveStack) {
 	if (gamestate_pegs_remaining(gs) == 1) {
 		//printf("Found a winning sequence. Final state:\n");
 		//gamestate_print(gs);
 		
-		alist_t *solution = alist_new_copy(moveStack);
-		alist_add(solutions, solution);
-		mem_release(solution);
+		add_solution(moveStack->entries, moveStack->size);
 		
 		gamesPlayed++;
 		
 		return;
 	}
 	
-	alist_t *legalMoves = gamestate_legal_moves(gs);
+	// everything this node allocates in the region is discarded on return
+	mem_mark_t nodeMark = mem_region_mark();
+	alist_t *legalMoves = gamestate_legal_moves_in_region(gs);
 	
 	if (alist_is_empty(legalMoves)) {
 		gamesPlayed++;
-		mem_release(legalMoves);
+		mem_region_reset(nodeMark);
 		return;
 	}
 	
+	mem_mark_t childMark = mem_region_mark();
 	for (int i = 0; i < legalMoves->size; i++) {
 		move_t *m = alist_get(legalMoves, i);
-		gamestate_t *nextState = gamestate_apply_move(gs, m);
-		alist_add(moveStack, m);
+		gamestate_t *nextState = gamestate_apply_move_in_region(gs, m);
+		packed_move_list_add(moveStack, move_encode(m));
 		search(nextState, moveStack);
 		
-		alist_remove_last(moveStack);
-		mem_release(nextState);
+		packed_move_list_remove_last(moveStack);
+		mem_region_reset(childMark);
+	}
+	
+	mem_region_reset(nodeMark);
+}
+
+// the same search as search(), on a bitboard
+static void search_bitboard(bitboard_t bb, packed_move_list_t *moveStack) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		add_solution(moveStack->entries, moveStack->size);
+		gamesPlayed++;
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	
+	if (moveCount == 0) {
+		gamesPlayed++;
+		return;
+	}
+	
+	for (int i = 0; i < moveCount; i++) {
+		packed_move_list_add(moveStack, bb.board->jumps[legalMoves[i]].packed);
+		search_bitboard(bitboard_apply_move(bb, legalMoves[i]), moveStack);
+		packed_move_list_remove_last(moveStack);
+	}
+}
+
+// the same search as search_bitboard(), working each child's legal moves
+// out from legal, bb's set, rather than from scratch
+static void search_incremental(bitboard_t bb, const bitboard_legal_set_t *legal, packed_move_list_t *moveStack) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		add_solution(moveStack->entries, moveStack->size);
+		gamesPlayed++;
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_set_moves(bb.tables, legal, legalMoves);
+	
+	if (moveCount == 0) {
+		gamesPlayed++;
+		return;
+	}
+	
+	bitboard_legal_set_t next;
+	for (int i = 0; i < moveCount; i++) {
+		bitboard_legal_set_apply(bb.tables, legal, legalMoves[i], &next);
+		packed_move_list_add(moveStack, bb.board->jumps[legalMoves[i]].packed);
+		search_incremental(bitboard_apply_move(bb, legalMoves[i]), &next, moveStack);
+		packed_move_list_remove_last(moveStack);
+	}
+}
+
+// the same search as search(), on a single game state that is changed in
+// place. moveStack has room for a move per hole on the board, and depth is
+// the number of moves on it. legalMoves holds a list per depth, and pegs is
+// scratch space for gamestate_legal_moves_into(); once they have grown to
+// fit, nothing is allocated per node.
+static void search_in_place(gamestate_t *gs, packed_move_t *moveStack, int depth,
+							move_list_t *legalMoves, coord_list_t *pegs) {
+	if (gamestate_pegs_remaining(gs) == 1) {
+		add_solution(moveStack, depth);
+		gamesPlayed++;
+		return;
+	}
+	
+	move_list_t *moves = &legalMoves[depth];
+	int moveCount = gamestate_legal_moves_into(gs, moves, pegs);
+	
+	if (moveCount == 0) {
+		gamesPlayed++;
+		return;
+	}
+	
+	for (int i = 0; i < moveCount; i++) {
+		move_t *m = &moves->entries[i];
+		gamestate_make_move(gs, m);
+		moveStack[depth] = move_encode(m);
+		search_in_place(gs, moveStack, depth + 1, legalMoves, pegs);
+		gamestate_unmake_move(gs, m);
+	}
+}
+
+// the same search as search_bitboard(), except that children which are
+// rotations or reflections of each other are only searched once. They have
+// identical subtrees, so the one that is searched counts for all of them:
+// every game below this node stands for weight games of the full tree.
+// Only the searched child's solutions are kept.
+//
+// Two children can only be images of each other under a symmetry of their
+// parent, so nodes without one (most of them) skip the comparison.
+static void search_symmetric(bitboard_t bb, long weight, packed_move_list_t *moveStack) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		add_weighted_solution(moveStack->entries, moveStack->size, weight);
+		gamesPlayed += weight;
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	
+	if (moveCount == 0) {
+		gamesPlayed += weight;
+		return;
+	}
+	
+	int stabilizer = bitboard_stabilizer(bb);
+	
+	// group the children into symmetry classes, in move order
+	bitboard_t classChild[moveCount];
+	int classMove[moveCount];
+	long classSize[moveCount];
+	int classCount = 0;
+	for (int i = 0; i < moveCount; i++) {
+		bitboard_t child = bitboard_apply_move(bb, legalMoves[i]);
+		int c = classCount;
+		for (int s = 1; s < BOARD_SYMMETRIES && c == classCount; s++) {
+			if (stabilizer & (1 << s)) {
+				bitboard_bits_t image = bitboard_transform(child, s);
+				for (c = 0; c < classCount && !bitboard_bits_eq(classChild[c].pegs, image); c++) {
+				}
+			}
+		}
+		if (c == classCount) {
+			classChild[classCount] = child;
+			classMove[classCount] = legalMoves[i];
+			classSize[classCount] = 0;
+			classCount++;
+		}
+		classSize[c]++;
+	}
+	
+	for (int c = 0; c < classCount; c++) {
+		packed_move_list_add(moveStack, bb.board->jumps[classMove[c]].packed);
+		search_symmetric(classChild[c], weight * classSize[c], moveStack);
+		packed_move_list_remove_last(moveStack);
+	}
+}
+
+// sets games and wins to the number of games played from bb and how many of
+// them are won, working out each position (up to symmetry) only once.
+// Nothing is added to the solutions list: this engine never plays a game
+// through, so it has no move sequences to keep.
+static void count_games(bitboard_t bb, memo_table_t *memo, memo_count_t *games, memo_count_t *wins) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		*games = 1;
+		*wins = 1;
+		return;
+	}
+	
+	bitboard_bits_t key = bitboard_canonical(bb);
+	const memo_entry_t *known = memo_table_find(memo, key);
+	if (known != NULL) {
+		*games = known->games;
+		*wins = known->wins;
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	
+	*games = moveCount == 0;
+	*wins = 0;
+	for (int i = 0; i < moveCount; i++) {
+		memo_count_t childGames, childWins;
+		count_games(bitboard_apply_move(bb, legalMoves[i]), memo, &childGames, &childWins);
+		*games += childGames;
+		*wins += childWins;
+	}
+	
+	memo_table_insert(memo, key, *games, *wins);
+}
+
+// the same count as count_games(), keeping the counts in a transposition
+// table that other threads may be using at the same time. Positions are
+// told apart by their hash, and symmetric ones aren't merged.
+static void count_games_shared(bitboard_t bb, ttable_t *table, ttable_stats_t *stats, memo_count_t *games, memo_count_t *wins) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		*games = 1;
+		*wins = 1;
+		return;
+	}
+	
+	if (ttable_find(table, bb.hash, games, wins, stats)) {
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	
+	*games = moveCount == 0;
+	*wins = 0;
+	for (int i = 0; i < moveCount; i++) {
+		memo_count_t childGames, childWins;
+		count_games_shared(bitboard_apply_move(bb, legalMoves[i]), table, stats, &childGames, &childWins);
+		*games += childGames;
+		*wins += childWins;
+	}
+	
+	ttable_insert(table, bb.hash, *games, *wins, stats);
+}
+
+static inline int bitboard_pegs_cmp(const bitboard_t *lhs, const bitboard_t *rhs) {
+	return bitboard_bits_cmp(&lhs->pegs, &rhs->pegs);
+}
+
+DEFINE_TYPED_LIST(bitboard_list, bitboard_t, bitboard_pegs_cmp)
+
+// what the parallel engine's threads share: the positions a few moves into
+// the game, which they take one at a time, and the table
+typedef struct parallel_work {
+	bitboard_list_t tasks;
+	int next;  // the next task to take, advanced atomically
+	ttable_t *table;
+} parallel_work_t;
+
+typedef struct parallel_worker {
+	pthread_t thread;
+	parallel_work_t *work;
+	memo_count_t games;
+	memo_count_t wins;
+	ttable_stats_t stats;
+} parallel_worker_t;
+
+static void *parallel_worker_run(void *arg) {
+	parallel_worker_t *worker = arg;
+	parallel_work_t *work = worker->work;
+	
+	worker->games = 0;
+	worker->wins = 0;
+	ttable_stats_init(&worker->stats);
+	for (;;) {
+		int i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+		if (i >= work->tasks.size) {
+			break;
+		}
+		
+		memo_count_t games, wins;
+		count_games_shared(work->tasks.entries[i], work->table, &worker->stats, &games, &wins);
+		worker->games += games;
+		worker->wins += wins;
+	}
+	return NULL;
+}
+
+// adds the positions depth moves below bb to tasks, once for each way of
+// getting there, and counts the games that end before then into games and wins
+static void split_tasks(bitboard_t bb, int depth, bitboard_list_t *tasks, memo_count_t *games, memo_count_t *wins) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		(*games)++;
+		(*wins)++;
+		return;
+	}
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	if (moveCount == 0) {
+		(*games)++;
+	} else if (depth == 0) {
+		bitboard_list_add(tasks, bb);
+	} else {
+		for (int i = 0; i < moveCount; i++) {
+			split_tasks(bitboard_apply_move(bb, legalMoves[i]), depth - 1, tasks, games, wins);
+		}
+	}
+}
+
+// counts the games below bb on threadCount threads sharing table. The
+// threads only touch bitboards and the table, so the allocator doesn't need
+// to be built thread-safe.
+static void count_in_parallel(bitboard_t bb, ttable_t *table, ttable_stats_t *stats, memo_count_t *games, memo_count_t *wins) {
+	parallel_work_t work;
+	bitboard_list_init(&work.tasks);
+	work.next = 0;
+	work.table = table;
+	
+	// deep enough to give every thread several tasks to balance the load
+	for (int depth = 0; work.tasks.size < 8 * threadCount; depth++) {
+		bitboard_list_clear(&work.tasks);
+		*games = 0;
+		*wins = 0;
+		split_tasks(bb, depth, &work.tasks, games, wins);
+		if (work.tasks.size == 0) {
+			break;
+		}
+	}
+	
+	// pick the legal move kernel before the threads race to
+	bitboard_kernel();
+	
+	parallel_worker_t workers[threadCount];
+	for (int t = 0; t < threadCount; t++) {
+		workers[t].work = &work;
+		if (pthread_create(&workers[t].thread, NULL, parallel_worker_run, &workers[t]) != 0) {
+			perror("Couldn't start search thread");
+			exit(1);
+		}
+	}
+	
+	ttable_stats_init(stats);
+	for (int t = 0; t < threadCount; t++) {
+		pthread_join(workers[t].thread, NULL);
+		*games += workers[t].games;
+		*wins += workers[t].wins;
+		ttable_stats_add(stats, &workers[t].stats);
+	}
+	
+	bitboard_list_destroy(&work.tasks);
+}
+
+// finds the same solutions as search_bitboard(), in the same order, but
+// only those ending in one of pagodas' targets, and skips every position
+// the pagodas show can't get there. values holds bb's value under each of
+// them. Games that are cut short aren't played out, so they aren't counted
+// in gamesPlayed.
+static void search_pruned(bitboard_t bb, const pagoda_set_t *pagodas, const int *values, packed_move_list_t *moveStack) {
+	if (bitboard_pegs_remaining(bb) == 1) {
+		if (!bitboard_bits_is_zero(bitboard_bits_and(bb.pegs, pagodas->targets))) {
+			add_solution(moveStack->entries, moveStack->size);
+		}
+		return;
 	}
+	nodesSearched++;
 	
-	mem_release(legalMoves);
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	
+	int childValues[pagodas->count + 1];
+	for (int i = 0; i < moveCount; i++) {
+		pagoda_set_apply(pagodas, legalMoves[i], values, childValues);
+		if (!pagoda_set_can_finish(pagodas, childValues)) {
+			nodesPruned++;
+			continue;
+		}
+		
+		packed_move_list_add(moveStack, bb.board->jumps[legalMoves[i]].packed);
+		search_pruned(bitboard_apply_move(bb, legalMoves[i]), pagodas, childValues, moveStack);
+		packed_move_list_remove_last(moveStack);
+	}
 }
 
 static long diff_usec(struct timeval start, struct timeval end) {
@@ -88,33 +507,267 @@ static long diff_usec(struct timeval start, struct timeval end) {
 	return (long) (secs * 1000000L) + usecs;
 }
 
+DEFINE_TYPED_LIST(bits_list, bitboard_bits_t, bitboard_bits_cmp)
+
+// adds the pegs of every position in the game tree below bb to positions
+static void collect_positions(bitboard_t bb, bits_list_t *positions) {
+	bits_list_add(positions, bb.pegs);
+	
+	int legalMoves[bb.board->jump_count];
+	int moveCount = bitboard_legal_moves(bb, legalMoves);
+	for (int i = 0; i < moveCount; i++) {
+		collect_positions(bitboard_apply_move(bb, legalMoves[i]), positions);
+	}
+}
+
+// times each supported legal move kernel over every position in the game
+// tree. They should all find the same number of legal moves.
+static void benchmark_kernels() {
+	const int passes = 10;
+	bitboard_t start = bitboard_new(rows, coord_index(emptyRow, emptyHole));
+	
+	bits_list_t positions;
+	bits_list_init(&positions);
+	collect_positions(start, &positions);
+	printf("Positions:       %6d\n", positions.size);
+	
+	int legalMoves[start.board->jump_count];
+	for (int k = 0; k < BITBOARD_KERNELS; k++) {
+		if (!bitboard_kernel_supported(k)) {
+			printf("Kernel %-6s    not supported\n", bitboard_kernel_name(k));
+			continue;
+		}
+		bitboard_select_kernel(k);
+		
+		long found = 0;
+		struct timeval before, after;
+		gettimeofday(&before, NULL);
+		for (int pass = 0; pass < passes; pass++) {
+			for (int i = 0; i < positions.size; i++) {
+				bitboard_t bb = start;
+				bb.pegs = positions.entries[i];
+				found += bitboard_legal_moves(bb, legalMoves);
+			}
+		}
+		gettimeofday(&after, NULL);
+		
+		printf("Kernel %-6s %8.2f ns per position (%ld legal moves)\n",
+			   bitboard_kernel_name(k),
+			   diff_usec(before, after) * 1000.0 / ((double) passes * positions.size),
+			   found / passes);
+	}
+	
+	bits_list_destroy(&positions);
+}
+
 static void run() {
-	solutions = alist_new();
+	mem_autorelease_pool_t pool = mem_autorelease_pool_push();
+	kept_solution_list_init(&solutions);
+	packed_move_list_init(&solutionMoves);
 	
 	gettimeofday(&startTime, NULL);
 	
-	coord_t *emptyHole = coord_new(3, 2);
-	gamestate_t *gs = gamestate_new(5, emptyHole);
-	mem_release(emptyHole);
-	emptyHole = NULL;
+	// the board's jump table is built once, up front
+	struct timeval boardTime;
+	board_get(rows);
+	gettimeofday(&boardTime, NULL);
+	
+	packed_move_list_t moveStack;
+	packed_move_list_init(&moveStack);
 	
-	alist_t *moveStack = alist_new();
-	search(gs, moveStack);
+	memo_count_t games, wins;
+	size_t memoPositions = 0;
+	ttable_t table;
+	ttable_stats_t tableStats;
 	
-	int solutionCount = solutions->size;
+	if (engine == ENGINE_PARALLEL) {
+		ttable_init(&table, tableSize);
+		count_in_parallel(bitboard_new(rows, coord_index(emptyRow, emptyHole)), &table, &tableStats, &games, &wins);
+	} else if (engine == ENGINE_PRUNED) {
+		bitboard_t bb = bitboard_new(rows, coord_index(emptyRow, emptyHole));
+		pagoda_set_t pagodas;
+		pagoda_set_init(&pagodas, bb.board, bitboard_bits_bit(coord_index(targetRow, targetHole)));
+		pagodasChecked = pagodas.count;
+		
+		int values[pagodas.count + 1];
+		for (int p = 0; p < pagodas.count; p++) {
+			values[p] = pagoda_value(pagodas.pagodas[p], bb);
+		}
+		if (pagoda_set_can_finish(&pagodas, values)) {
+			search_pruned(bb, &pagodas, values, &moveStack);
+		} else {
+			nodesPruned++;
+		}
+		pagoda_set_destroy(&pagodas);
+	} else if (engine == ENGINE_COUNTING) {
+		memo_table_t memo;
+		memo_table_init(&memo);
+		count_games(bitboard_new(rows, coord_index(emptyRow, emptyHole)), &memo, &games, &wins);
+		memoPositions = memo.size;
+		memo_table_destroy(&memo);
+	} else if (engine == ENGINE_BITBOARD) {
+		search_bitboard(bitboard_new(rows, coord_index(emptyRow, emptyHole)), &moveStack);
+	} else if (engine == ENGINE_INCREMENTAL) {
+		bitboard_t bb = bitboard_new(rows, coord_index(emptyRow, emptyHole));
+		bitboard_legal_set_t legal;
+		bitboard_legal_set_init(bb, &legal);
+		search_incremental(bb, &legal, &moveStack);
+	} else if (engine == ENGINE_SYMMETRIC) {
+		search_symmetric(bitboard_new(rows, coord_index(emptyRow, emptyHole)), 1, &moveStack);
+	} else if (engine == ENGINE_IN_PLACE) {
+		gamestate_t *gs = gamestate_new(rows, coord_at(emptyRow, emptyHole));
+		int holes = gs->board->hole_count;
+		packed_move_t inPlaceStack[holes];
+		move_list_t legalMoves[holes];
+		coord_list_t pegs;
+		for (int d = 0; d < holes; d++) {
+			move_list_init(&legalMoves[d]);
+			move_list_reserve(&legalMoves[d], gs->board->jump_count);
+		}
+		coord_list_init(&pegs);
+		coord_list_reserve(&pegs, holes);
+		
+		search_in_place(gs, inPlaceStack, 0, legalMoves, &pegs);
+		
+		for (int d = 0; d < holes; d++) {
+			move_list_destroy(&legalMoves[d]);
+		}
+		coord_list_destroy(&pegs);
+		mem_release(gs);
+	} else {
+		gamestate_t *gs = gamestate_new(rows, coord_at(emptyRow, emptyHole));
+		search(gs, &moveStack);
+		mem_release(gs);
+	}
 	
-	mem_release(moveStack);
-	mem_release(solutions);
-	mem_release(gs);
+	packed_move_list_destroy(&moveStack);
+	kept_solution_list_destroy(&solutions);
+	packed_move_list_destroy(&solutionMoves);
+	mem_autorelease_pool_drain(pool);
 	
 	gettimeofday(&endTime, NULL);
 	
-	printf("Games played:    %6ld\n", gamesPlayed);
-	printf("Solutions found: %6d\n", solutionCount);
+	if (engine != ENGINE_COUNTING && engine != ENGINE_PARALLEL) {
+		games = gamesPlayed;
+		wins = solutionCount;
+	}
+	
+	char digits[MEMO_COUNT_DIGITS];
+	if (engine != ENGINE_PRUNED) {
+		printf("Games played:    %6s\n", memo_count_format(games, digits));
+	}
+	printf("Solutions found: %6s\n", memo_count_format(wins, digits));
+	if (solutionsDropped > 0) {
+		printf("Solutions kept:  %6d (the first found; %ld more only counted)\n",
+			   MAX_KEPT_SOLUTIONS, solutionsDropped);
+	}
 	printf("Time elapsed:    %6ldms\n", diff_usec(startTime, endTime) / 1000);
+	printf("Board setup:     %6ldus\n", diff_usec(startTime, boardTime));
+	if (engine == ENGINE_COUNTING) {
+		printf("Memo positions:  %6zu\n", memoPositions);
+	}
+	if (engine == ENGINE_PRUNED) {
+		printf("Pagodas checked: %6d of %d\n", pagodasChecked, pagoda_library(board_get(rows))->count);
+		printf("Nodes searched:  %6ld\n", nodesSearched);
+		printf("Nodes pruned:    %6ld\n", nodesPruned);
+	}
+	if (engine == ENGINE_PARALLEL) {
+		printf("Threads:         %6d\n", threadCount);
+		ttable_stats_print(&table, &tableStats);
+		ttable_destroy(&table);
+	}
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--rows=N] [--empty=ROW,HOLE] [--engine=reference|bitboard|incremental|in-place|symmetric|counting|parallel|pruned]\n"
+					"       %*s [--target=ROW,HOLE] [--threads=N] [--table-size=ENTRIES]\n"
+					"       %*s [--kernel=scalar|sse4|avx2] [--benchmark-kernels]\n"
+					"--engine=pruned needs --target, the hole its solutions have to end in\n",
+			argv0, (int) strlen(argv0), "", (int) strlen(argv0), "");
+	exit(1);
 }
 
 int main (int argc, const char * argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--engine=reference") == 0) {
+			engine = ENGINE_REFERENCE;
+		} else if (strcmp(argv[i], "--engine=bitboard") == 0) {
+			engine = ENGINE_BITBOARD;
+		} else if (strcmp(argv[i], "--engine=incremental") == 0) {
+			engine = ENGINE_INCREMENTAL;
+		} else if (strcmp(argv[i], "--engine=in-place") == 0) {
+			engine = ENGINE_IN_PLACE;
+		} else if (strcmp(argv[i], "--engine=symmetric") == 0) {
+			engine = ENGINE_SYMMETRIC;
+		} else if (strcmp(argv[i], "--engine=counting") == 0) {
+			engine = ENGINE_COUNTING;
+		} else if (strcmp(argv[i], "--engine=parallel") == 0) {
+			engine = ENGINE_PARALLEL;
+		} else if (strcmp(argv[i], "--engine=pruned") == 0) {
+			engine = ENGINE_PRUNED;
+		} else if (strncmp(argv[i], "--threads=", 10) == 0) {
+			threadCount = atoi(argv[i] + 10);
+		} else if (strncmp(argv[i], "--table-size=", 13) == 0) {
+			tableSize = atol(argv[i] + 13);
+		} else if (strncmp(argv[i], "--kernel=", 9) == 0) {
+			int kernel = 0;
+			while (kernel < BITBOARD_KERNELS && strcmp(argv[i] + 9, bitboard_kernel_name(kernel)) != 0) {
+				kernel++;
+			}
+			if (kernel == BITBOARD_KERNELS) {
+				usage(argv[0]);
+			}
+			bitboard_select_kernel(kernel);
+		} else if (strncmp(argv[i], "--rows=", 7) == 0) {
+			rows = atoi(argv[i] + 7);
+		} else if (strncmp(argv[i], "--empty=", 8) == 0) {
+			if (sscanf(argv[i] + 8, "%d,%d", &emptyRow, &emptyHole) != 2) {
+				usage(argv[0]);
+			}
+		} else if (strncmp(argv[i], "--target=", 9) == 0) {
+			if (sscanf(argv[i] + 9, "%d,%d", &targetRow, &targetHole) != 2) {
+				usage(argv[0]);
+			}
+		} else if (strcmp(argv[i], "--benchmark-kernels") == 0) {
+			benchmarkKernels = 1;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	
+	if (rows < 1 || coord_index(rows + 1, 1) > 1 << MOVE_PACKED_BITS) {
+		fprintf(stderr, "Can't solve a board with %d rows\n", rows);
+		exit(1);
+	}
+	if (emptyRow < 1 || emptyRow > rows || emptyHole < 1 || emptyHole > emptyRow) {
+		fprintf(stderr, "Hole %d,%d isn't on a %d-row board\n", emptyRow, emptyHole, rows);
+		exit(1);
+	}
+	
+	if (targetRow != 0 && (targetRow < 1 || targetRow > rows || targetHole < 1 || targetHole > targetRow)) {
+		fprintf(stderr, "Hole %d,%d isn't on a %d-row board\n", targetRow, targetHole, rows);
+		exit(1);
+	}
+	if (targetRow != 0 && engine != ENGINE_PRUNED) {
+		fprintf(stderr, "Only --engine=pruned can look for solutions ending in a given hole\n");
+		exit(1);
+	}
+	if (targetRow == 0 && engine == ENGINE_PRUNED) {
+		// every position with a peg left is worth at least as much as the
+		// lightest hole, so no pagoda can rule out a solution ending anywhere
+		fprintf(stderr, "--engine=pruned needs a --target to prune towards\n");
+		usage(argv[0]);
+	}
+	if (threadCount < 1 || tableSize < TTABLE_PROBES) {
+		fprintf(stderr, "Need at least 1 thread and %d table entries\n", TTABLE_PROBES);
+		exit(1);
+	}
+	
+	if (benchmarkKernels) {
+		benchmark_kernels();
+		return 0;
+	}
+	
 	run();
 	mem_summary();
     return 0;
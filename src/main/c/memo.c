@@ -0,0 +1,95 @@
+/*
+ *  memo.c
+ *  performance_c
+ */
+
+#include "memo.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MEMO_INITIAL_CAPACITY 1024
+
+static int memo_type_id = -1;
+
+static void allocate(memo_table_t *table, size_t capacity) {
+	table->entries = calloc(capacity, sizeof(memo_entry_t));
+	if (table->entries == NULL) {
+		perror("Couldn't allocate memo table");
+		exit(1);
+	}
+	table->capacity = capacity;
+	if (memo_type_id < 0) {
+		memo_type_id = mem_type_id("memo_table");
+	}
+	mem_profile_resize(memo_type_id, 0, sizeof(memo_entry_t) * capacity);
+}
+
+// the slot holding pegs, or the free slot where it belongs
+static memo_entry_t *probe(const memo_table_t *table, bitboard_bits_t pegs) {
+	size_t mask = table->capacity - 1;
+	size_t i = bitboard_bits_hash(pegs) & mask;
+	while (!bitboard_bits_is_zero(table->entries[i].pegs) && !bitboard_bits_eq(table->entries[i].pegs, pegs)) {
+		i = (i + 1) & mask;
+	}
+	return &table->entries[i];
+}
+
+static void grow(memo_table_t *table) {
+	memo_entry_t *old = table->entries;
+	size_t old_capacity = table->capacity;
+	
+	allocate(table, old_capacity * 2);
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (!bitboard_bits_is_zero(old[i].pegs)) {
+			*probe(table, old[i].pegs) = old[i];
+		}
+	}
+	
+	mem_profile_resize(memo_type_id, sizeof(memo_entry_t) * old_capacity, 0);
+	free(old);
+}
+
+void memo_table_init(memo_table_t *table) {
+	table->size = 0;
+	allocate(table, MEMO_INITIAL_CAPACITY);
+}
+
+void memo_table_destroy(memo_table_t *table) {
+	mem_profile_resize(memo_type_id, sizeof(memo_entry_t) * table->capacity, 0);
+	free(table->entries);
+	table->entries = NULL;
+	table->size = 0;
+	table->capacity = 0;
+}
+
+const memo_entry_t *memo_table_find(const memo_table_t *table, bitboard_bits_t pegs) {
+	const memo_entry_t *e = probe(table, pegs);
+	return bitboard_bits_is_zero(e->pegs) ? NULL : e;
+}
+
+void memo_table_insert(memo_table_t *table, bitboard_bits_t pegs, memo_count_t games, memo_count_t wins) {
+	if (2 * (table->size + 1) > table->capacity) {
+		grow(table);
+	}
+	memo_entry_t *e = probe(table, pegs);
+	e->pegs = pegs;
+	e->games = games;
+	e->wins = wins;
+	table->size++;
+}
+
+char *memo_count_format(memo_count_t n, char *buf) {
+	char digits[MEMO_COUNT_DIGITS];
+	int count = 0;
+	do {
+		digits[count++] = '0' + (int) (n % 10);
+		n /= 10;
+	} while (n != 0);
+	
+	for (int i = 0; i < count; i++) {
+		buf[i] = digits[count - 1 - i];
+	}
+	buf[count] = '\0';
+	return buf;
+}
@@ -0,0 +1,57 @@
+/*
+ *  memo.h
+ *  performance_c
+ */
+
+#ifndef __MEMO_H__
+#define __MEMO_H__
+
+#include <stddef.h>
+#include "bitboard.h"
+
+/*
+ * Memo tables.
+ *
+ * The number of games below a position depends only on the position, not
+ * on how it was reached, so a search that only counts games can work each
+ * position out once and look it up every other time it comes across it. A
+ * memo table maps positions to the number of games played from them and
+ * how many of those end with a single peg.
+ *
+ * Counts are 128-bit: the number of games on a 7-row board is already too
+ * big for a long.
+ */
+
+typedef unsigned __int128 memo_count_t;
+
+// enough room for any memo_count_t in decimal, with its terminating NUL
+#define MEMO_COUNT_DIGITS 40
+
+typedef struct memo_entry {
+	bitboard_bits_t pegs;  // none for a free slot
+	memo_count_t games;
+	memo_count_t wins;
+} memo_entry_t;
+
+// an open-addressed hash table with linear probing. It grows to keep at
+// most half its slots in use, and entries are never removed.
+typedef struct memo_table {
+	size_t size;
+	size_t capacity;  // always a power of two
+	memo_entry_t *entries;
+} memo_table_t;
+
+void memo_table_init(memo_table_t *table);
+void memo_table_destroy(memo_table_t *table);
+
+// the entry for pegs, or NULL if there isn't one
+const memo_entry_t *memo_table_find(const memo_table_t *table, bitboard_bits_t pegs);
+
+// records the counts for pegs, which must not be in the table yet
+void memo_table_insert(memo_table_t *table, bitboard_bits_t pegs, memo_count_t games, memo_count_t wins);
+
+// writes n in decimal into buf, which must have room for MEMO_COUNT_DIGITS
+// characters, and returns buf
+char *memo_count_format(memo_count_t n, char *buf);
+
+#endif
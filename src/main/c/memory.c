@@ -8,126 +8,955 @@
 #include "memory.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+
+#ifdef THREADSAFE_MEMORY
+#include <pthread.h>
+#endif
 
 #define ALLOC_MAGIC 0xDEAFB00B
+#define FREED_MAGIC 0xF5EED
 
-#ifdef DEBUG_MEMORY
-static int freed_allocations = 0;
-static int total_allocations = 0;
+// size of the static area immortal objects are allocated from. More is
+// malloc'd in chunks of this size if it runs out.
+#define IMMORTAL_AREA_SIZE 65536
+
+// objects larger than this are not pooled; they go straight to malloc/free
+#define POOL_MAX_SIZE 512
+
+// pooled and region sizes are rounded up to a multiple of this, so that a
+// type whose size varies (like a list's shared buffer) needs at most
+// POOL_MAX_SIZE / POOL_SIZE_STEP classes
+#define POOL_SIZE_STEP 16
+#define SIZE_CLASS(n) (((n) + POOL_SIZE_STEP - 1) & ~(size_t) (POOL_SIZE_STEP - 1))
+
+// number of bytes requested from malloc each time a pool runs dry
+#define POOL_SLAB_SIZE 16384
+
+// maximum number of distinct (type, size, destructor, kind) combinations.
+// Compact headers store the class index in 8 bits.
+#define MAX_CLASSES 256
+
+// number of slots in the class and pool hash tables. Must be a power of 2
+// and bigger than MAX_CLASSES.
+#define POOL_TABLE_SIZE 512
+
+// number of slots in the type name -> type id hash table. Must be a power of
+// 2 and bigger than MEM_MAX_TYPES.
+#define TYPE_TABLE_SIZE 128
+
+// minimum number of bytes requested from malloc for each region chunk
+#define REGION_CHUNK_SIZE 65536
+
+// round n up to a multiple of the pointer size
+#define ALIGN_UP(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+struct alloc_header;
+struct mem_thread;
+
+// what kind of memory a block lives in
+enum {
+	KIND_HEAP,                    // pooled; see mem_alloc()
+	KIND_LARGE,                   // malloc'd, since it's too big to pool
+	KIND_REGION,                  // see mem_region_alloc()
+	KIND_IMMORTAL                 // see mem_alloc_immortal()
+};
+
+// Blocks too big to pool all share one class, so that they never use up the
+// class table. What their class would have recorded goes in a prefix in
+// front of the header instead.
+typedef struct large_prefix {
+	size_t size;
+	void (*destructor)(void *);
+	int type_id;
+} large_prefix_t;
 
-// linked list of allocation info
-typedef struct alloc_info {
-	int allocations;
+#define LARGE_TYPE "large"
+#define LARGE_PREFIX(ah) ((large_prefix_t *) (ah) - 1)
+
+// A class describes every block with the same type, size class, destructor
+// and kind. Classes are shared by all threads and are never freed, so a block
+// header can refer to its class by index.
+typedef struct mem_class {
 	const char *type;
-	struct alloc_info *next;
-} alloc_info_t;
+	size_t size;                  // payload size
+	size_t stride;                // header + payload, rounded up for alignment
+	void (*destructor)(void *);
+	int kind;
+	int index;                    // position in the classes array
+	int type_id;                  // see mem_type_id()
+	int bucket;                   // size histogram bucket for this size
+} mem_class_t;
 
-static alloc_info_t *first_alloc_info = NULL;
+// A pool recycles blocks of one class for one thread. Freed blocks go onto
+// the pool's free list and are handed out again by the next mem_alloc() for
+// that type, so the system allocator is only consulted when the free list
+// is empty and the current slab is used up.
+typedef struct mem_pool {
+	mem_class_t *cls;
+	struct mem_thread *owner;     // the only thread that touches the free list
+	struct type_stats *stats;     // the owner's statistics for this type
+	struct alloc_header *free_list;
+	char *slab_next;              // next uncarved block in the current slab
+	char *slab_end;
+	long hits;                    // allocations served from the free list
+	long misses;                  // allocations that had to carve a new block
+	long slabs;                   // number of slabs obtained from malloc
+} mem_pool_t;
 
-static alloc_info_t *get_alloc_info(const char *type) {
-	alloc_info_t *ai = first_alloc_info;
-	while (ai != NULL) {
-		if (ai->type == type) break;
-		ai = ai->next;
-	}
+#ifdef COMPACT_HEADERS
+// The compact header packs the reference count and the class index into one
+// 32-bit word; the destructor and type name come from the class. The magic
+// number is only checked in DEBUG_MEMORY builds, but the space is kept in
+// every build so the payload stays 8-byte aligned.
+#define REFS_BITS 24
+#define REFS_MASK ((1u << REFS_BITS) - 1)
+
+typedef struct alloc_header {
+	uint32_t word;
+	uint32_t magic;
+} alloc_header_t;
+
+#define REFS_FIELD word
+#define REFS_VALUE(x) ((x) & REFS_MASK)
+#define MAX_REFERENCES REFS_MASK
+#define HDR_CLASS(ah) (&classes[(ah)->word >> REFS_BITS])
+#define HDR_DESTRUCTOR(ah) (HDR_CLASS(ah)->kind == KIND_LARGE ? LARGE_PREFIX(ah)->destructor : HDR_CLASS(ah)->destructor)
+#define HDR_POOL(t, ah) pool_for_class((t), HDR_CLASS(ah))
+#define HDR_INIT(ah, pool, destr) ((ah)->word = ((uint32_t) (pool)->cls->index << REFS_BITS) | 1)
+#define HDR_SET_REFS(ah, refs) ((ah)->word = ((ah)->word & ~REFS_MASK) | (refs))
+#ifdef DEBUG_MEMORY
+#define CHECK_MAGIC
+#endif
+#else
+typedef struct alloc_header {
+	int magic;
+	int references;
+	void (*destructor)(void *);
+	mem_pool_t *pool;
+} alloc_header_t;
+
+#define REFS_FIELD references
+#define REFS_VALUE(x) (x)
+#define MAX_REFERENCES INT_MAX
+#define HDR_CLASS(ah) ((ah)->pool->cls)
+#define HDR_DESTRUCTOR(ah) ((ah)->destructor)
+#ifdef THREADSAFE_MEMORY
+#define HDR_POOL(t, ah) ((ah)->pool->owner == (t) ? (ah)->pool : pool_for_class((t), (ah)->pool->cls))
+#else
+#define HDR_POOL(t, ah) ((ah)->pool)
+#endif
+#define HDR_INIT(ah, pl, destr) ((ah)->references = 1, (ah)->destructor = (destr), (ah)->pool = (pl))
+#define HDR_SET_REFS(ah, refs) ((ah)->references = (refs))
+#define CHECK_MAGIC
+#endif
+
+#define HDR_REFS(ah) REFS_VALUE((ah)->REFS_FIELD)
+
+// Reference counts at or above DOOMED_REFERENCES are never changed by
+// mem_retain() or mem_release(). Objects allocated with mem_alloc_immortal()
+// have IMMORTAL_REFERENCES; live region blocks are given DOOMED_REFERENCES
+// while mem_region_reset() destroys them.
+#define IMMORTAL_REFERENCES MAX_REFERENCES
+#define DOOMED_REFERENCES (MAX_REFERENCES - 1)
+
+// Reference count updates. In the thread-safe build these are atomic: the
+// decrement has release semantics so that all of a thread's writes to the
+// object happen before another thread can see the count reach 0, and the
+// thread that does see 0 issues an acquire fence before running the
+// destructor. The single-threaded build uses plain arithmetic.
+#ifdef THREADSAFE_MEMORY
+#define REFS_INCREMENT(ah) REFS_VALUE(__atomic_add_fetch(&(ah)->REFS_FIELD, 1, __ATOMIC_RELAXED))
+#define REFS_DECREMENT(ah) REFS_VALUE(__atomic_sub_fetch(&(ah)->REFS_FIELD, 1, __ATOMIC_RELEASE))
+#define ACQUIRE_FENCE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define REFS_INCREMENT(ah) REFS_VALUE(++(ah)->REFS_FIELD)
+#define REFS_DECREMENT(ah) REFS_VALUE(--(ah)->REFS_FIELD)
+#define ACQUIRE_FENCE()
+#endif
+
+// The region is a stack of chunks that blocks are bump-allocated from.
+// Chunks are kept around after a reset so the next descent reuses them.
+typedef struct region_chunk {
+	struct region_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+} region_chunk_t;
+
+// the size histogram has one bucket per power of 2, the last one catching
+// everything bigger
+#define PROFILE_BUCKETS 16
+
+#ifndef NO_MEM_PROFILE
+// allocation statistics for one type
+typedef struct type_stats {
+	long allocations;             // total number of objects ever allocated
+	long frees;                   // total number of objects ever destroyed
+	long live;                    // allocations - frees
+	long peak_live;
+	long live_bytes;
+	long peak_bytes;
+	long resizes;                 // number of times a buffer grew
+	long resized_bytes;           // total number of bytes buffers grew by
+	long histogram[PROFILE_BUCKETS];
+} type_stats_t;
+#endif
+
+// All of the allocator's mutable state. The single-threaded build has
+// exactly one of these; the thread-safe build gives every thread its own,
+// so pools, regions and statistics never need locking. A block may still be
+// released by a thread other than the one that allocated it, in which case
+// it goes onto the releasing thread's free list.
+typedef struct mem_thread {
+	// this thread's pools, hashed by (type, size, destructor, kind) for
+	// mem_alloc() and indexed by class for mem_release(). Pools are never
+	// freed.
+	mem_pool_t *pool_table[POOL_TABLE_SIZE];
+	mem_pool_t *pools[MAX_CLASSES];
 	
-	// if not found, create a new one
-	if (ai == NULL) {
-		ai = malloc(sizeof(alloc_info_t));
-		if (ai == NULL) {
-			perror("Failed to malloc an alloc_info");
+	region_chunk_t *first_chunk;
+	region_chunk_t *current_chunk;
+	long region_allocations;
+	size_t region_bytes;
+	size_t region_peak_bytes;
+	
+	// blocks waiting for their destructors to run; see destroy()
+	int destroying;
+	alloc_header_t **destroy_queue;
+	size_t destroy_head;
+	size_t destroy_tail;
+	size_t destroy_capacity;
+	size_t destroy_peak;
+	
+	// stack of autoreleased objects; each pool is a position in it
+	void **autoreleased;
+	size_t autoreleased_count;
+	size_t autoreleased_capacity;
+	int autorelease_depth;
+	long autoreleased_total;
+	
+#ifndef NO_MEM_PROFILE
+	type_stats_t type_stats[MEM_MAX_TYPES];
+#endif
+	
+	struct mem_thread *next;      // all threads' state, for mem_summary()
+} mem_thread_t;
+
+#ifdef THREADSAFE_MEMORY
+static __thread mem_thread_t *this_thread = NULL;
+static mem_thread_t *first_thread = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// returns the calling thread's allocator state, creating it on first use
+static mem_thread_t *current_thread() {
+	mem_thread_t *t = this_thread;
+	if (t == NULL) {
+		t = calloc(1, sizeof(mem_thread_t));
+		if (t == NULL) {
+			perror("Failed to allocate per-thread memory state");
 			exit(1);
 		}
-		
-		ai->type = type;
-		ai->allocations = 0;
-		ai->next = first_alloc_info; // will be NULL for first ai created
-		
-		first_alloc_info = ai;
+		pthread_mutex_lock(&threads_lock);
+		t->next = first_thread;
+		first_thread = t;
+		pthread_mutex_unlock(&threads_lock);
+		this_thread = t;
 	}
-	
-	return ai;
+	return t;
 }
+#else
+static mem_thread_t main_thread;
+static mem_thread_t *first_thread = &main_thread;
+#define current_thread() (&main_thread)
 #endif
 
-typedef struct alloc_header {
-	int magic;
-	int references;
-	void (*destructor)(void *);
-	const char *type;
-} alloc_header_t;
+// The type registry: names by id, and an open-addressed table that maps the
+// name pointers to ids. Types are never unregistered.
+static const char *type_names[MEM_MAX_TYPES];
+static int type_count = 0;
+static int type_table[TYPE_TABLE_SIZE];
+#ifdef THREADSAFE_MEMORY
+static pthread_mutex_t types_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-void *mem_alloc(size_t size, void (*destructor)(void *), const char *type) {
-	void *mem = malloc(sizeof(alloc_header_t) + size);
-	if (mem == NULL) {
+int mem_type_id(const char *type) {
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_lock(&types_lock);
+#endif
+	unsigned int slot = (unsigned int) ((uintptr_t) type >> 3) & (TYPE_TABLE_SIZE - 1);
+	int id;
+	for (;;) {
+		// table entries are id + 1, so that 0 means empty
+		id = type_table[slot] - 1;
+		if (id < 0) {
+			if (type_count == MEM_MAX_TYPES) {
+				fprintf(stderr, "Too many distinct types for the allocation profiler\n");
+				exit(1);
+			}
+			id = type_count++;
+			type_names[id] = type;
+			type_table[slot] = id + 1;
+			break;
+		}
+		if (type_names[id] == type) {
+			break;
+		}
+		slot = (slot + 1) & (TYPE_TABLE_SIZE - 1);
+	}
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_unlock(&types_lock);
+#endif
+	return id;
+}
+
+// returns the histogram bucket for an object of the given size
+static int size_bucket(size_t size) {
+	int bucket = 0;
+	while (size > 1 && bucket < PROFILE_BUCKETS - 1) {
+		size = (size + 1) >> 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+#ifndef NO_MEM_PROFILE
+static void profile_alloc(mem_pool_t *pool) {
+	type_stats_t *ts = pool->stats;
+	ts->allocations++;
+	ts->histogram[pool->cls->bucket]++;
+	if (++ts->live > ts->peak_live) {
+		ts->peak_live = ts->live;
+	}
+	ts->live_bytes += pool->cls->size;
+	if (ts->live_bytes > ts->peak_bytes) {
+		ts->peak_bytes = ts->live_bytes;
+	}
+}
+
+static void profile_free(mem_pool_t *pool) {
+	type_stats_t *ts = pool->stats;
+	ts->frees++;
+	ts->live--;
+	ts->live_bytes -= pool->cls->size;
+}
+#endif
+
+void mem_profile_resize(int type_id, size_t old_size, size_t new_size) {
+#ifndef NO_MEM_PROFILE
+	type_stats_t *ts = &current_thread()->type_stats[type_id];
+	if (old_size == 0) {
+		ts->allocations++;
+		ts->histogram[size_bucket(new_size)]++;
+		if (++ts->live > ts->peak_live) {
+			ts->peak_live = ts->live;
+		}
+	} else if (new_size == 0) {
+		ts->frees++;
+		ts->live--;
+	} else if (new_size > old_size) {
+		ts->resizes++;
+		ts->resized_bytes += new_size - old_size;
+	}
+	ts->live_bytes += (long) new_size - (long) old_size;
+	if (ts->live_bytes > ts->peak_bytes) {
+		ts->peak_bytes = ts->live_bytes;
+	}
+#else
+	(void) type_id;
+	(void) old_size;
+	(void) new_size;
+#endif
+}
+
+// All classes, and a hash table of (index + 1) keyed the same way as the
+// per-thread pool tables.
+static mem_class_t classes[MAX_CLASSES];
+static int class_count = 0;
+static int class_table[POOL_TABLE_SIZE];
+#ifdef THREADSAFE_MEMORY
+static pthread_mutex_t classes_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned int class_hash(const char *type, size_t size, void (*destructor)(void *), int kind) {
+	return (unsigned int) (((uintptr_t) type >> 3) ^ (size * 31) ^ ((uintptr_t) destructor >> 4) ^ kind)
+		& (POOL_TABLE_SIZE - 1);
+}
+
+static int class_matches(mem_class_t *cls, const char *type, size_t size, void (*destructor)(void *), int kind) {
+	return cls->type == type && cls->size == size && cls->destructor == destructor && cls->kind == kind;
+}
+
+// finds the class for the given combination, creating it if necessary
+static mem_class_t *get_class(const char *type, size_t size, void (*destructor)(void *), int kind) {
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_lock(&classes_lock);
+#endif
+	unsigned int slot = class_hash(type, size, destructor, kind);
+	mem_class_t *cls;
+	for (;;) {
+		int idx = class_table[slot] - 1;
+		if (idx < 0) {
+			if (class_count == MAX_CLASSES) {
+				fprintf(stderr, "Too many distinct (type, size) combinations for the memory pools\n");
+				exit(1);
+			}
+			cls = &classes[class_count];
+			cls->type = type;
+			cls->size = size;
+			cls->stride = ALIGN_UP(sizeof(alloc_header_t) + (size < sizeof(void *) ? sizeof(void *) : size));
+			cls->destructor = destructor;
+			cls->kind = kind;
+			cls->index = class_count;
+			cls->type_id = mem_type_id(type);
+			cls->bucket = size_bucket(size);
+			class_table[slot] = ++class_count;
+			break;
+		}
+		cls = &classes[idx];
+		if (class_matches(cls, type, size, destructor, kind)) {
+			break;
+		}
+		slot = (slot + 1) & (POOL_TABLE_SIZE - 1);
+	}
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_unlock(&classes_lock);
+#endif
+	return cls;
+}
+
+// returns the calling thread's pool for the given class, creating it if
+// necessary
+static mem_pool_t *pool_for_class(mem_thread_t *t, mem_class_t *cls) {
+	mem_pool_t *pool = t->pools[cls->index];
+	if (pool == NULL) {
+		pool = malloc(sizeof(mem_pool_t));
+		if (pool == NULL) {
+			perror("Failed to malloc a memory pool");
+			exit(1);
+		}
+		pool->cls = cls;
+		pool->owner = t;
+#ifndef NO_MEM_PROFILE
+		pool->stats = &t->type_stats[cls->type_id];
+#endif
+		pool->free_list = NULL;
+		pool->slab_next = NULL;
+		pool->slab_end = NULL;
+		pool->hits = 0;
+		pool->misses = 0;
+		pool->slabs = 0;
+		t->pools[cls->index] = pool;
+	}
+	return pool;
+}
+
+// finds the pool for the given combination, creating it if necessary
+static mem_pool_t *get_pool(mem_thread_t *t, const char *type, size_t size, void (*destructor)(void *), int kind) {
+	unsigned int slot = class_hash(type, size, destructor, kind);
+	for (;;) {
+		mem_pool_t *pool = t->pool_table[slot];
+		if (pool == NULL) {
+			pool = pool_for_class(t, get_class(type, size, destructor, kind));
+			t->pool_table[slot] = pool;
+			return pool;
+		}
+		if (class_matches(pool->cls, type, size, destructor, kind)) {
+			return pool;
+		}
+		slot = (slot + 1) & (POOL_TABLE_SIZE - 1);
+	}
+}
+
+// carves a fresh block out of the pool's current slab, getting a new slab
+// from the system allocator when the current one is used up
+static alloc_header_t *pool_carve(mem_pool_t *pool) {
+	size_t stride = pool->cls->stride;
+	if (pool->slab_next == NULL || pool->slab_next + stride > pool->slab_end) {
+		size_t slab_size = POOL_SLAB_SIZE - POOL_SLAB_SIZE % stride;
+		char *slab = malloc(slab_size);
+		if (slab == NULL) {
+			perror("Failed to allocate a memory pool slab");
+			exit(1);
+		}
+		pool->slab_next = slab;
+		pool->slab_end = slab + slab_size;
+		pool->slabs++;
+	}
+	alloc_header_t *ah = (alloc_header_t *) pool->slab_next;
+	pool->slab_next += stride;
+	return ah;
+}
+
+static void *large_alloc(mem_thread_t *t, size_t size, void (*destructor)(void *), const char *type) {
+	mem_pool_t *pool = get_pool(t, LARGE_TYPE, 0, NULL, KIND_LARGE);
+	large_prefix_t *prefix = malloc(sizeof(large_prefix_t) + sizeof(alloc_header_t) + size);
+	if (prefix == NULL) {
 		perror("Failed to allocate some memory");
 		exit(1);
 	}
+	prefix->size = size;
+	prefix->destructor = destructor;
+	prefix->type_id = mem_type_id(type);
+	
+	alloc_header_t *ah = (alloc_header_t *) (prefix + 1);
+	ah->magic = ALLOC_MAGIC;
+	HDR_INIT(ah, pool, destructor);
+	
+	mem_profile_resize(prefix->type_id, 0, size);
+	
+	return ah + 1;
+}
+
+void *mem_alloc(size_t size, void (*destructor)(void *), const char *type) {
+	mem_thread_t *t = current_thread();
+	if (size > POOL_MAX_SIZE) {
+		return large_alloc(t, size, destructor, type);
+	}
+	
+	mem_pool_t *pool = get_pool(t, type, SIZE_CLASS(size), destructor, KIND_HEAP);
+	alloc_header_t *ah;
+	
+	if (pool->free_list != NULL) {
+		ah = pool->free_list;
+		pool->free_list = *(alloc_header_t **) (ah + 1);
+		pool->hits++;
+	} else {
+		ah = pool_carve(pool);
+		pool->misses++;
+	}
 	
-	alloc_header_t *ah = mem;
 	ah->magic = ALLOC_MAGIC;
-	ah->references = 1;
-	ah->destructor = destructor;
-	ah->type = type;
+	HDR_INIT(ah, pool, destructor);
+	
+#ifndef NO_MEM_PROFILE
+	profile_alloc(pool);
+#endif
+	
+	return ah + 1;
+}
 
-#ifdef DEBUG_MEMORY
-	alloc_info_t *ai = get_alloc_info(type);
-	ai->allocations = ai->allocations + 1;
+// Runs the destructor of a block whose last reference is gone, then either
+// puts its memory back into its pool or, for region blocks, leaves it to be
+// reclaimed by mem_region_reset().
+static void finalize(mem_thread_t *t, alloc_header_t *ah) {
+	(void) t;  // only HDR_POOL() needs it, and only in some header modes
+	ACQUIRE_FENCE();
+	HDR_DESTRUCTOR(ah)(ah + 1);
+	
+	mem_pool_t *pool = HDR_POOL(t, ah);
 	
-	total_allocations++;
+	if (pool->cls->kind == KIND_LARGE) {
+		large_prefix_t *prefix = LARGE_PREFIX(ah);
+		mem_profile_resize(prefix->type_id, prefix->size, 0);
+		ah->magic = FREED_MAGIC;
+		free(prefix);
+		return;
+	}
+	
+#ifndef NO_MEM_PROFILE
+	profile_free(pool);
 #endif
 	
-	return mem + sizeof(alloc_header_t);
+	if (pool->cls->kind == KIND_REGION) {
+		return;
+	}
+	
+	ah->magic = FREED_MAGIC;
+	*(alloc_header_t **) (ah + 1) = pool->free_list;
+	pool->free_list = ah;
+}
+
+// Finalizes everything on the destruction queue, including blocks that are
+// queued by the destructors as it goes.
+static void drain_destroy_queue(mem_thread_t *t) {
+	while (t->destroy_head < t->destroy_tail) {
+		finalize(t, t->destroy_queue[t->destroy_head++]);
+	}
+	t->destroy_head = 0;
+	t->destroy_tail = 0;
+}
+
+// Destroys a block whose reference count has just reached 0. If this
+// happens while another destructor is running, the block is queued instead,
+// so that releasing the last reference to a large structure runs its
+// destructors one after the other rather than recursively.
+static void destroy(mem_thread_t *t, alloc_header_t *ah) {
+	if (t->destroying) {
+		if (t->destroy_tail == t->destroy_capacity) {
+			size_t capacity = t->destroy_capacity == 0 ? 64 : t->destroy_capacity * 2;
+			alloc_header_t **queue = realloc(t->destroy_queue, sizeof(alloc_header_t *) * capacity);
+			if (queue == NULL) {
+				perror("Failed to grow the destruction queue");
+				exit(1);
+			}
+			t->destroy_queue = queue;
+			t->destroy_capacity = capacity;
+		}
+		t->destroy_queue[t->destroy_tail++] = ah;
+		if (t->destroy_tail - t->destroy_head > t->destroy_peak) {
+			t->destroy_peak = t->destroy_tail - t->destroy_head;
+		}
+		return;
+	}
+	
+	t->destroying = 1;
+	finalize(t, ah);
+	drain_destroy_queue(t);
+	t->destroying = 0;
 }
 
 void mem_retain(void *addr) {
 	void *headerptr = addr - sizeof(alloc_header_t);
 	alloc_header_t *ah = headerptr;
-	if (ah->magic != ALLOC_MAGIC) {
+	if (HDR_REFS(ah) >= DOOMED_REFERENCES) {
+		// immortal, or in a region that is being reset
+		return;
+	}
+#ifdef CHECK_MAGIC
+	if ((unsigned int) ah->magic != ALLOC_MAGIC) {
 		fprintf(stderr, "Yikes, bad magic: %x", ah->magic);
 		exit(1);
 	}
+#endif
 	
-	ah->references = ah->references + 1;
+#ifdef DEBUG_MEMORY
+	if (REFS_INCREMENT(ah) >= DOOMED_REFERENCES) {
+		fprintf(stderr, "Reference count overflow for a %s\n", HDR_CLASS(ah)->type);
+		exit(1);
+	}
+#else
+	(void) REFS_INCREMENT(ah);
+#endif
 }
 
 
 void mem_release(void *addr) {
 	void *headerptr = addr - sizeof(alloc_header_t);
 	alloc_header_t *ah = headerptr;
-	if (ah->magic != ALLOC_MAGIC) {
+	if (HDR_REFS(ah) >= DOOMED_REFERENCES) {
+		// immortal, or in a region that is being reset, in which case the
+		// reset takes care of running its destructor
+		return;
+	}
+#ifdef CHECK_MAGIC
+	if ((unsigned int) ah->magic != ALLOC_MAGIC) {
 		fprintf(stderr, "Yikes, bad magic: %x", ah->magic);
 		exit(1);
 	}
+#endif
 	
-	ah->references = ah->references - 1;
-	if (ah->references == 0) {
-		ah->destructor(addr);
-		ah->magic = 0xF5EED;
-		
-#ifdef DEBUG_MEMORY
-		alloc_info_t *ai = get_alloc_info(ah->type);
-		ai->allocations = ai->allocations - 1;
+	if (REFS_DECREMENT(ah) == 0) {
+		destroy(current_thread(), ah);
+	}
+}
+
+// Immortal objects are bump-allocated from a static area (and from
+// malloc'd chunks once that is full) and are never freed.
+static void *immortal_area[IMMORTAL_AREA_SIZE / sizeof(void *)];
+static char *immortal_next = (char *) immortal_area;
+static char *immortal_end = (char *) immortal_area + sizeof(immortal_area);
+static long immortal_count = 0;
+static size_t immortal_bytes = 0;
+#ifdef THREADSAFE_MEMORY
+static pthread_mutex_t immortal_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void *mem_alloc_immortal(size_t size, const char *type) {
+	// immortal blocks never go back to a pool, so all those of a type share
+	// one class whatever their size
+	mem_pool_t *pool = get_pool(current_thread(), type, 0, NULL, KIND_IMMORTAL);
+	size_t stride = ALIGN_UP(sizeof(alloc_header_t) + size);
+	
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_lock(&immortal_lock);
+#endif
+	if (immortal_next + stride > immortal_end) {
+		size_t chunk_size = stride > IMMORTAL_AREA_SIZE ? stride : IMMORTAL_AREA_SIZE;
+		immortal_next = malloc(chunk_size);
+		if (immortal_next == NULL) {
+			perror("Failed to allocate space for immortal objects");
+			exit(1);
+		}
+		immortal_end = immortal_next + chunk_size;
+	}
+	alloc_header_t *ah = (alloc_header_t *) immortal_next;
+	immortal_next += stride;
+	immortal_count++;
+	immortal_bytes += stride;
+#ifdef THREADSAFE_MEMORY
+	pthread_mutex_unlock(&immortal_lock);
+#endif
+	
+	ah->magic = ALLOC_MAGIC;
+	HDR_INIT(ah, pool, NULL);
+	HDR_SET_REFS(ah, IMMORTAL_REFERENCES);
+	
+	return ah + 1;
+}
+
+void *mem_autorelease(void *addr) {
+	mem_thread_t *t = current_thread();
+	if (t->autorelease_depth == 0) {
+		fprintf(stderr, "mem_autorelease() called with no autorelease pool in place\n");
+		exit(1);
+	}
+	if (t->autoreleased_count == t->autoreleased_capacity) {
+		size_t capacity = t->autoreleased_capacity == 0 ? 256 : t->autoreleased_capacity * 2;
+		void **autoreleased = realloc(t->autoreleased, sizeof(void *) * capacity);
+		if (autoreleased == NULL) {
+			perror("Failed to grow the autorelease pool");
+			exit(1);
+		}
+		t->autoreleased = autoreleased;
+		t->autoreleased_capacity = capacity;
+	}
+	t->autoreleased[t->autoreleased_count++] = addr;
+	t->autoreleased_total++;
+	return addr;
+}
+
+mem_autorelease_pool_t mem_autorelease_pool_push() {
+	mem_thread_t *t = current_thread();
+	t->autorelease_depth++;
+	return t->autoreleased_count;
+}
 
-		freed_allocations++;
+void mem_autorelease_pool_drain(mem_autorelease_pool_t pool) {
+	mem_thread_t *t = current_thread();
+	
+	// destructors may autorelease more objects into this pool, so keep
+	// going until nothing new shows up
+	while (t->autoreleased_count > pool) {
+		size_t count = t->autoreleased_count;
+		int was_destroying = t->destroying;
+		t->destroying = 1;
+		for (size_t i = pool; i < count; i++) {
+			mem_release(t->autoreleased[i]);
+		}
+		t->autoreleased_count = pool;
+		if (!was_destroying) {
+			drain_destroy_queue(t);
+			t->destroying = 0;
+		}
+	}
+	t->autorelease_depth--;
+}
+
+mem_mark_t mem_region_mark() {
+	mem_thread_t *t = current_thread();
+	if (t->current_chunk == NULL) {
+		mem_mark_t mark = { NULL, 0 };
+		return mark;
+	}
+	mem_mark_t mark = { t->current_chunk, t->current_chunk->used };
+	return mark;
+}
+
+static region_chunk_t *region_chunk_new(size_t min_size) {
+	size_t size = min_size > REGION_CHUNK_SIZE ? min_size : REGION_CHUNK_SIZE;
+	region_chunk_t *chunk = malloc(sizeof(region_chunk_t) + size);
+	if (chunk == NULL) {
+		perror("Failed to allocate a region chunk");
+		exit(1);
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+void *mem_region_alloc(size_t size, void (*destructor)(void *), const char *type) {
+	mem_thread_t *t = current_thread();
+	mem_pool_t *pool = get_pool(t, type, SIZE_CLASS(size), destructor, KIND_REGION);
+	size_t stride = pool->cls->stride;
+	
+	if (t->current_chunk == NULL) {
+		// the region is empty, so whatever the first chunk held before the
+		// last reset is gone
+		if (t->first_chunk == NULL) {
+			t->first_chunk = region_chunk_new(stride);
+		}
+		t->current_chunk = t->first_chunk;
+		t->current_chunk->used = 0;
+	}
+	
+	// move on to the next chunk (reusing one from an earlier descent if
+	// there is one big enough) when this one is full
+	region_chunk_t *chunk = t->current_chunk;
+	while (chunk->used + stride > chunk->size) {
+		if (chunk->next == NULL || chunk->next->size < stride) {
+			region_chunk_t *new_chunk = region_chunk_new(stride);
+			new_chunk->next = chunk->next;
+			chunk->next = new_chunk;
+		}
+		chunk = chunk->next;
+		chunk->used = 0;
+	}
+	t->current_chunk = chunk;
+	
+	alloc_header_t *ah = (alloc_header_t *) (chunk->data + chunk->used);
+	chunk->used += stride;
+	
+	ah->magic = ALLOC_MAGIC;
+	HDR_INIT(ah, pool, destructor);
+	
+	t->region_allocations++;
+	t->region_bytes += stride;
+	if (t->region_bytes > t->region_peak_bytes) {
+		t->region_peak_bytes = t->region_bytes;
+	}
+	
+#ifndef NO_MEM_PROFILE
+	profile_alloc(pool);
 #endif
-		
-		free(ah);
+	
+	return ah + 1;
+}
+
+// Calls fn on every block allocated since mark, in allocation order.
+static void region_walk(mem_thread_t *t, mem_mark_t mark, void (*fn)(mem_thread_t *, alloc_header_t *)) {
+	region_chunk_t *chunk = mark.chunk != NULL ? mark.chunk : t->first_chunk;
+	size_t offset = mark.used;
+	while (chunk != NULL) {
+		while (offset < chunk->used) {
+			alloc_header_t *ah = (alloc_header_t *) (chunk->data + offset);
+			offset += HDR_CLASS(ah)->stride;
+			fn(t, ah);
+		}
+		if (chunk == t->current_chunk) break;
+		chunk = chunk->next;
+		offset = 0;
+	}
+}
+
+static void region_doom(mem_thread_t *t, alloc_header_t *ah) {
+	(void) t;  // there to match region_walk()'s callback
+	// blocks that mem_release() already destroyed have no references left
+	// and are skipped by region_destroy()
+	if (HDR_REFS(ah) > 0) {
+		HDR_SET_REFS(ah, DOOMED_REFERENCES);
+	}
+}
+
+static void region_destroy(mem_thread_t *t, alloc_header_t *ah) {
+	t->region_bytes -= HDR_CLASS(ah)->stride;
+	if (HDR_REFS(ah) == DOOMED_REFERENCES) {
+		HDR_SET_REFS(ah, 0);
+		finalize(t, ah);
+	}
+}
+
+void mem_region_reset(mem_mark_t mark) {
+	mem_thread_t *t = current_thread();
+	if (t->current_chunk == NULL) {
+		return;
+	}
+	
+	// Doom every block first so the destructors of the blocks destroyed
+	// early can release blocks that haven't been destroyed yet.
+	int was_destroying = t->destroying;
+	t->destroying = 1;
+	region_walk(t, mark, region_doom);
+	region_walk(t, mark, region_destroy);
+	if (!was_destroying) {
+		drain_destroy_queue(t);
+		t->destroying = 0;
+	}
+	
+	if (mark.chunk == NULL) {
+		t->current_chunk = NULL;
+	} else {
+		t->current_chunk = mark.chunk;
+		t->current_chunk->used = mark.used;
 	}
 }
 
 void mem_summary() {
-#ifdef DEBUG_MEMORY
+	mem_thread_t *t;
+	
+	printf("Memory pool summary:\n");
+	for (t = first_thread; t != NULL; t = t->next) {
+		for (int i = 0; i < class_count; i++) {
+			mem_pool_t *pool = t->pools[i];
+			if (pool != NULL && pool->cls->kind == KIND_HEAP) {
+				printf("   Pool %10s (%4lu bytes, %4lu with header): %10ld hits %8ld misses %4ld slabs\n",
+					   pool->cls->type, (unsigned long) pool->cls->size, (unsigned long) pool->cls->stride,
+					   pool->hits, pool->misses, pool->slabs);
+			}
+		}
+	}
+	long region_allocations = 0;
+	size_t region_peak_bytes = 0;
+	for (t = first_thread; t != NULL; t = t->next) {
+		region_allocations += t->region_allocations;
+		region_peak_bytes += t->region_peak_bytes;
+	}
+	printf("Region allocations: %ld (peak %lu bytes)\n",
+		   region_allocations, (unsigned long) region_peak_bytes);
+	long autoreleased_total = 0;
+	size_t destroy_peak = 0;
+	for (t = first_thread; t != NULL; t = t->next) {
+		autoreleased_total += t->autoreleased_total;
+		if (t->destroy_peak > destroy_peak) {
+			destroy_peak = t->destroy_peak;
+		}
+	}
+	printf("Autoreleased objects: %ld (longest destruction queue %lu)\n",
+		   autoreleased_total, (unsigned long) destroy_peak);
+	printf("Immortal objects: %ld (%lu bytes)\n", immortal_count, (unsigned long) immortal_bytes);
+#ifndef NO_MEM_PROFILE
+	// Per-thread statistics are merged here. A type's live count can be
+	// negative for one thread if it released objects another thread
+	// allocated, and the merged peaks are the sum of the per-thread peaks.
+	type_stats_t merged[MEM_MAX_TYPES];
+	long total_allocations = 0;
+	long freed_allocations = 0;
+	for (int id = 0; id < type_count; id++) {
+		type_stats_t *m = &merged[id];
+		*m = (type_stats_t) { 0 };
+		for (t = first_thread; t != NULL; t = t->next) {
+			type_stats_t *ts = &t->type_stats[id];
+			m->allocations += ts->allocations;
+			m->frees += ts->frees;
+			m->live += ts->live;
+			m->peak_live += ts->peak_live;
+			m->live_bytes += ts->live_bytes;
+			m->peak_bytes += ts->peak_bytes;
+			m->resizes += ts->resizes;
+			m->resized_bytes += ts->resized_bytes;
+			for (int b = 0; b < PROFILE_BUCKETS; b++) {
+				m->histogram[b] += ts->histogram[b];
+			}
+		}
+		total_allocations += m->allocations;
+		freed_allocations += m->frees;
+	}
+	
 	printf("Memory allocation summary:\n");
-	printf("Total count of objects allocated:   %8d\n", total_allocations);
-	printf("Of those, number of objects freed:  %8d\n", freed_allocations);
-	printf("Remaining live allocations (leaks): %8d\n", total_allocations - freed_allocations);
-	alloc_info_t *ai = first_alloc_info;
-	while (ai != NULL) {
-		printf("   Remaining allocations for %10s: %8d\n", ai->type, ai->allocations); 
-		ai = ai->next;
+	printf("Total count of objects allocated:   %8ld\n", total_allocations);
+	printf("Of those, number of objects freed:  %8ld\n", freed_allocations);
+	printf("Remaining live allocations (leaks): %8ld\n", total_allocations - freed_allocations);
+	
+	// one CSV record per type. The histogram field lists size:count pairs,
+	// where size is the upper bound of each power-of-2 bucket.
+	printf("type,allocations,frees,live,peak_live,live_bytes,peak_bytes,resizes,resized_bytes,size_histogram\n");
+	for (int id = 0; id < type_count; id++) {
+		type_stats_t *m = &merged[id];
+		printf("%s,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,",
+			   type_names[id], m->allocations, m->frees, m->live, m->peak_live,
+			   m->live_bytes, m->peak_bytes, m->resizes, m->resized_bytes);
+		const char *separator = "";
+		for (int b = 0; b < PROFILE_BUCKETS; b++) {
+			if (m->histogram[b] != 0) {
+				printf("%s%lu:%ld", separator, 1UL << b, m->histogram[b]);
+				separator = ";";
+			}
+		}
+		printf("\n");
 	}
 #else
-	printf("Memory debugging was disabled at compile time.\n");
+	printf("Allocation profiling was disabled at compile time.\n");
 #endif
 }
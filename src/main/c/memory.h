@@ -10,6 +10,29 @@
 
 #include <stdlib.h>
 
+// Thread safety
+// -------------
+// By default, none of these functions may be called concurrently. Building
+// with -DTHREADSAFE_MEMORY makes reference counts atomic and gives each
+// thread its own pools, allocation region and statistics, so objects can be
+// shared between threads and retained/released from any of them. The
+// single-threaded build pays none of these costs.
+//
+// Regions are per-thread: a mark may only be reset by the thread that took it.
+
+// Object headers
+// --------------
+// Every block carries a header in front of the address handed out. The
+// default header holds a magic number, the reference count, the destructor
+// and a pointer to the block's pool (24 bytes on 64-bit machines). Building
+// with -DCOMPACT_HEADERS shrinks it to a single 32-bit word holding a 24-bit
+// reference count and an 8-bit index into a table of (type, size,
+// destructor) classes, padded to 8 bytes for alignment. In that mode the
+// magic number is only checked when DEBUG_MEMORY is also defined, the
+// reference count of an object must stay below 2^24 - 2, and there can be
+// at most 256 distinct combinations of type, size, destructor and
+// allocation kind.
+
 // allocates size bytes of memory and returns the address of the first byte.
 // Note that some additional memory is allocated for accounting purposes,
 // but this extra overhead is not for use by the caller.
@@ -25,6 +48,15 @@
 // For this system to be helpful, be sure to pass in exactly the same pointer
 // every time you allocate the same object. See mem_summary() for details.
 // 
+// Small objects are carved out of per-type slabs. When they are released,
+// their memory goes back onto a free list for that type and size rather than
+// to the system allocator, so the next mem_alloc() with the same type and
+// size can reuse it. Sizes are rounded up to a multiple of 16 bytes first,
+// so that sizes that are close together share a free list. This means memory
+// given to a type is never returned to the system, and that it really pays
+// to pass the same type pointer every time. Objects bigger than 512 bytes
+// aren't pooled: they are malloc'd and freed one at a time.
+//
 // Memory allocated using mem_alloc() must be released by a call to
 // mem_release() with exactly the same address as was returned by this function.
 //
@@ -32,6 +64,17 @@
 // the request, the whole program will exit.
 void *mem_alloc(size_t size, void (*destructor)(void *), const char *type);
 
+// Allocates size bytes for an object that will never be freed, such as an
+// interned coordinate. The memory comes from a static area that is set aside
+// for this purpose. mem_retain() and mem_release() may be called on the
+// returned address as usual, but they return right away without touching
+// the reference count, so there's no need for a destructor.
+//
+// The type argument is there for consistency with mem_alloc() and to
+// document what the object is. Immortal objects don't show up in the
+// allocation profile; mem_summary() reports their count and size separately.
+void *mem_alloc_immortal(size_t size, const char *type);
+
 // Increases the reference count for the given block of memory.
 // addr must be an address previously returned by mem_alloc().
 void mem_retain(void *addr);
@@ -40,10 +83,92 @@ void mem_retain(void *addr);
 // If this causes the reference count to drop to 0, the memory block is
 // freed for reuse by future allocations.
 // addr must be an address previously returned by mem_alloc().
+//
+// Destructors never run recursively: when a destructor releases the last
+// reference to another object, that object is queued and destroyed after
+// the current destructor returns.
 void mem_release(void *addr);
 
+// Autorelease pools
+// -----------------
+// An autorelease pool defers a mem_release() until the pool is drained.
+// This lets a function hand out a temporary object (or add it to a list)
+// without having to hang on to it just to release it afterwards:
+//
+//   alist_add(moves, mem_autorelease(move_new(...)));
+//
+// Pools nest. mem_autorelease() always adds to the innermost pool, and it is
+// an error to call it when no pool has been pushed.
+typedef size_t mem_autorelease_pool_t;
+
+// Starts a new autorelease pool nested inside the current one.
+mem_autorelease_pool_t mem_autorelease_pool_push();
+
+// Releases every object that was autoreleased since the given pool was
+// pushed (including objects autoreleased by the destructors this runs),
+// and ends the pool.
+void mem_autorelease_pool_drain(mem_autorelease_pool_t pool);
+
+// Arranges for addr to be released when the innermost autorelease pool is
+// drained. Returns addr.
+void *mem_autorelease(void *addr);
+
+// A position in the allocation region, as returned by mem_region_mark().
+// The fields are private to memory.c.
+typedef struct mem_mark {
+	void *chunk;
+	size_t used;
+} mem_mark_t;
+
+// Returns a mark for the current top of the allocation region. Everything
+// allocated with mem_region_alloc() after this call can be discarded in one
+// go by passing the mark to mem_region_reset(). Marks nest, so a recursive
+// search can take one mark per depth.
+mem_mark_t mem_region_mark();
+
+// Like mem_alloc(), but the memory comes from the allocation region, which
+// costs nothing more than bumping a pointer. The returned block is reference
+// counted like any other: mem_retain() and mem_release() work, and the
+// destructor runs when the last reference is released. The memory itself,
+// however, is only reclaimed by mem_region_reset().
+//
+// Only use this for objects that are guaranteed not to be referenced after
+// the region is reset back past them.
+void *mem_region_alloc(size_t size, void (*destructor)(void *), const char *type);
+
+// Discards everything allocated by mem_region_alloc() since the given mark
+// was taken. Objects that still have references have their destructors
+// called (in allocation order) without the references being released
+// individually, so callers don't need to mem_release() them first.
+void mem_region_reset(mem_mark_t mark);
+
+// Allocation profiling
+// --------------------
+// Unless the program is built with -DNO_MEM_PROFILE, every allocation and
+// release is counted against its type. Each distinct type name pointer is
+// registered once and given a small integer id, so keeping the statistics
+// costs a few increments per operation.
+
+// maximum number of distinct type names
+#define MEM_MAX_TYPES 64
+
+// Returns the id for the given type name, registering it on first use.
+// As with mem_alloc(), the same pointer must be passed every time.
+int mem_type_id(const char *type);
+
+// Tells the profiler about a buffer that is managed with malloc/realloc/free
+// rather than mem_alloc(), such as the entries array of an alist.
+// old_size is 0 when the buffer is first allocated and new_size is 0 when
+// it is freed; anything else counts as a resize.
+void mem_profile_resize(int type_id, size_t old_size, size_t new_size);
+
 // Prints a summary of how many allocations have happened, how many were
-// subsequently freed, and how many remain unfreed.
+// subsequently freed, and how many remain unfreed, followed by one line of
+// CSV per type with its live and peak counts and bytes, resize counts and a
+// histogram of allocation sizes. The hit and miss counts of each type's
+// pool are printed as well.
+// In the thread-safe build, the statistics of all threads are merged. Call
+// this only once the other threads have stopped allocating.
 void mem_summary();
 
 #endif
@@ -93,3 +93,15 @@ void move_print(move_t *move) {
 		   move->to->row,     move->to->hole); 
 }
 
+move_t move_decode(packed_move_t pm) {
+	move_t m;
+	m.from = coord_at_index(move_packed_from(pm));
+	m.jumped = coord_at_index(move_packed_jumped(pm));
+	m.to = coord_at_index(move_packed_to(pm));
+	return m;
+}
+
+void move_packed_print(packed_move_t pm) {
+	move_t m = move_decode(pm);
+	move_print(&m);
+}
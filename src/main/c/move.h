@@ -37,6 +37,7 @@
 #ifndef __MOVE_H__
 #define __MOVE_H__
 
+#include <stdint.h>
 #include "coordinate.h"
 
 typedef struct move {
@@ -48,6 +49,75 @@ typedef struct move {
 move_t *move_new(coord_t *from, coord_t *jumped, coord_t *to);
 
 int move_cmp(move_t *lhs, move_t *rhs);
+
+// same ordering as move_cmp(), for comparing moves stored by value
+static inline int move_value_cmp(const move_t *lhs, const move_t *rhs) {
+	int diff = coord_value_cmp(lhs->from, rhs->from);
+	if (diff == 0) {
+		diff = coord_value_cmp(lhs->jumped, rhs->jumped);
+	}
+	if (diff == 0) {
+		diff = coord_value_cmp(lhs->to, rhs->to);
+	}
+	return diff;
+}
+
+// move_list_t: a list of moves stored by value (see typed_list.h). The list
+// doesn't retain the moves' coordinates, so they should be interned ones
+// (see coord_at()).
+DEFINE_TYPED_LIST(move_list, move_t, move_value_cmp)
 void move_print(move_t *move);
 
+/*
+ * Packed moves.
+ *
+ * A packed_move_t is a move encoded as a single integer: the hole indices
+ * (see coord_index()) of its from, jumped and to holes, 10 bits each, from
+ * the most significant end down. Packed moves need no allocation and no
+ * reference counting, and since hole index order is coord_cmp() order,
+ * comparing two packed moves as plain integers orders them exactly as
+ * move_cmp() would. Boards of up to 44 rows fit.
+ */
+typedef uint32_t packed_move_t;
+
+#define MOVE_PACKED_BITS 10
+#define MOVE_PACKED_MASK ((1u << MOVE_PACKED_BITS) - 1)
+
+static inline packed_move_t move_pack(coord_index_t from, coord_index_t jumped, coord_index_t to) {
+	return ((packed_move_t) from << (2 * MOVE_PACKED_BITS)) |
+		   ((packed_move_t) jumped << MOVE_PACKED_BITS) |
+		   (packed_move_t) to;
+}
+
+static inline coord_index_t move_packed_from(packed_move_t pm) {
+	return (pm >> (2 * MOVE_PACKED_BITS)) & MOVE_PACKED_MASK;
+}
+
+static inline coord_index_t move_packed_jumped(packed_move_t pm) {
+	return (pm >> MOVE_PACKED_BITS) & MOVE_PACKED_MASK;
+}
+
+static inline coord_index_t move_packed_to(packed_move_t pm) {
+	return pm & MOVE_PACKED_MASK;
+}
+
+static inline packed_move_t move_encode(const move_t *move) {
+	return move_pack(coord_index_of(move->from),
+					 coord_index_of(move->jumped),
+					 coord_index_of(move->to));
+}
+
+// the move as a move_t value made of interned coordinates
+move_t move_decode(packed_move_t pm);
+
+static inline int move_packed_cmp(const packed_move_t *lhs, const packed_move_t *rhs) {
+	return (*lhs > *rhs) - (*lhs < *rhs);
+}
+
+// prints the move in the same format as move_print()
+void move_packed_print(packed_move_t pm);
+
+// packed_move_list_t: a list of packed moves (see typed_list.h)
+DEFINE_TYPED_LIST(packed_move_list, packed_move_t, move_packed_cmp)
+
 #endif
@@ -0,0 +1,255 @@
+/*
+ *  pagoda.c
+ *  performance_c
+ */
+
+#include "pagoda.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// libraries built so far, indexed by row count
+static pagoda_library_t **libraries = NULL;
+static int library_count = 0;
+
+int pagoda_is_valid(const board_t *board, const int *weights) {
+	for (coord_index_t h = 0; h < board->hole_count; h++) {
+		if (weights[h] < 0) {
+			return 0;
+		}
+	}
+	for (int i = 0; i < board->jump_count; i++) {
+		const board_jump_t *j = &board->jumps[i];
+		if (weights[j->to] > weights[j->from] + weights[j->jumped]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int pagoda_value(const pagoda_t *p, bitboard_t bb) {
+	int value = 0;
+	for (coord_index_t h = 0; h < bb.board->hole_count; h++) {
+		if (bitboard_is_occupied(bb, h)) {
+			value += p->weights[h];
+		}
+	}
+	return value;
+}
+
+// fills in the rest of p from weights, which must be valid on board
+static void pagoda_init(pagoda_t *p, const board_t *board, const char *kind, int *weights) {
+	p->kind = kind;
+	p->weights = weights;
+	p->max_value = 0;
+	p->min_weight = weights[0];
+	p->max_weight = weights[0];
+	for (coord_index_t h = 0; h < board->hole_count; h++) {
+		p->max_value += weights[h];
+		p->min_weight = weights[h] < p->min_weight ? weights[h] : p->min_weight;
+		p->max_weight = weights[h] > p->max_weight ? weights[h] : p->max_weight;
+	}
+	
+	bitboard_bits_t *finals = mem_alloc_immortal(sizeof(bitboard_bits_t) * (p->max_value + 1), "pagodas");
+	for (int v = 0; v <= p->max_value; v++) {
+		finals[v] = bitboard_bits_zero();
+		for (coord_index_t h = 0; h < board->hole_count; h++) {
+			if (weights[h] <= v) {
+				finals[v] = bitboard_bits_or(finals[v], bitboard_bits_bit(h));
+			}
+		}
+	}
+	p->finals = finals;
+	
+	int *jump_delta = mem_alloc_immortal(sizeof(int) * board->jump_count, "pagodas");
+	for (int i = 0; i < board->jump_count; i++) {
+		const board_jump_t *j = &board->jumps[i];
+		jump_delta[i] = weights[j->to] - weights[j->from] - weights[j->jumped];
+	}
+	p->jump_delta = jump_delta;
+}
+
+// sets weights to 1 on the given holes (those that are on the board) and 0
+// everywhere else, and returns how many were on the board
+static int weigh_holes(const board_t *board, int *weights, const int holes[][2], int count) {
+	for (coord_index_t h = 0; h < board->hole_count; h++) {
+		weights[h] = 0;
+	}
+	int on_board = 0;
+	for (int i = 0; i < count; i++) {
+		int row = holes[i][0];
+		int hole = holes[i][1];
+		if (row >= 1 && row <= board->rowcount && hole >= 1 && hole <= row) {
+			weights[coord_index(row, hole)] = 1;
+			on_board++;
+		}
+	}
+	return on_board;
+}
+
+// the number of steps between two holes
+static int distance(coord_index_t from, coord_index_t to) {
+	int da = (coord_index_row(from) - coord_index_hole(from)) - (coord_index_row(to) - coord_index_hole(to));
+	int db = coord_index_hole(from) - coord_index_hole(to);
+	int dc = da + db;  // the third barycentric coordinate makes up the rest
+	da = abs(da);
+	db = abs(db);
+	dc = abs(dc);
+	return da > db ? (da > dc ? da : dc) : (db > dc ? db : dc);
+}
+
+static int fibonacci(int k) {
+	int a = 0, b = 1;
+	for (int i = 0; i < k; i++) {
+		int next = a + b;
+		a = b;
+		b = next;
+	}
+	return a;
+}
+
+static pagoda_library_t *library_new(const board_t *board) {
+	// four cosets, an up and a down triangle of each size at each hole, and
+	// one centred on each hole
+	int max_count = 4 + 5 * board->hole_count;
+	pagoda_t *pagodas = mem_alloc_immortal(sizeof(pagoda_t) * max_count, "pagodas");
+	int *weights = mem_alloc_immortal(sizeof(int) * max_count * board->hole_count, "pagodas");
+	int count = 0;
+	
+	// in barycentric terms (see board.c), a hole is in coset
+	// (row - hole) % 2, (hole - 1) % 2
+	for (int coset = 0; coset < 4; coset++) {
+		int *w = weights + count * board->hole_count;
+		int used = 0;
+		for (coord_index_t h = 0; h < board->hole_count; h++) {
+			int row = coord_index_row(h);
+			int hole = coord_index_hole(h);
+			w[h] = ((row - hole) % 2) * 2 + (hole - 1) % 2 == coset;
+			used += w[h];
+		}
+		if (used > 0) {
+			pagoda_init(&pagodas[count++], board, "coset", w);
+		}
+	}
+	
+	for (coord_index_t h = 0; h < board->hole_count; h++) {
+		int row = coord_index_row(h);
+		int hole = coord_index_hole(h);
+		for (int side = 1; side <= 2; side++) {
+			const int up[3][2] = { { row, hole }, { row + side, hole }, { row + side, hole + side } };
+			const int down[3][2] = { { row, hole }, { row, hole + side }, { row + side, hole + side } };
+			const int (*corners[2])[2] = { up, down };
+			for (int k = 0; k < 2; k++) {
+				int *w = weights + count * board->hole_count;
+				if (weigh_holes(board, w, corners[k], 3) == 3 && pagoda_is_valid(board, w)) {
+					pagoda_init(&pagodas[count++], board, "triangle", w);
+				}
+			}
+		}
+	}
+	
+	for (coord_index_t centre = 0; centre < board->hole_count; centre++) {
+		int *w = weights + count * board->hole_count;
+		int furthest = 0;
+		for (coord_index_t h = 0; h < board->hole_count; h++) {
+			int d = distance(centre, h);
+			furthest = d > furthest ? d : furthest;
+		}
+		for (coord_index_t h = 0; h < board->hole_count; h++) {
+			w[h] = fibonacci(furthest + 2 - distance(centre, h));
+		}
+		pagoda_init(&pagodas[count++], board, "distance", w);
+	}
+	
+	pagoda_library_t *library = mem_alloc_immortal(sizeof(pagoda_library_t), "pagodas");
+	library->hole_count = board->hole_count;
+	library->count = count;
+	library->pagodas = pagodas;
+	
+	// every pagoda in the library has to be valid for pruning to be sound
+	for (int i = 0; i < count; i++) {
+		if (!pagoda_is_valid(board, pagodas[i].weights)) {
+			printf("Library pagoda %d (%s) isn't valid on a %d-row board\n", i, pagodas[i].kind, board->rowcount);
+			exit(1);
+		}
+	}
+	
+	return library;
+}
+
+static int pagoda_set_type_id = -1;
+
+// how many bytes of buffers a set of count pagodas on board holds
+static size_t set_size(const board_t *board, int count) {
+	return (sizeof(pagoda_t *) + sizeof(bitboard_bits_t *) + sizeof(int) * board->jump_count) * count;
+}
+
+void pagoda_set_init(pagoda_set_t *set, const board_t *board, bitboard_bits_t targets) {
+	const pagoda_library_t *library = pagoda_library(board);
+	set->targets = targets;
+	set->count = 0;
+	set->pagodas = malloc(sizeof(pagoda_t *) * library->count);
+	set->finals = malloc(sizeof(bitboard_bits_t *) * library->count);
+	set->jump_deltas = malloc(sizeof(int) * board->jump_count * library->count);
+	if (set->pagodas == NULL || set->finals == NULL || set->jump_deltas == NULL) {
+		perror("Couldn't allocate pagoda set");
+		exit(1);
+	}
+	
+	for (int i = 0; i < library->count; i++) {
+		const pagoda_t *p = &library->pagodas[i];
+		int heaviest = 0;
+		int lightest = p->max_weight;
+		for (coord_index_t h = 0; h < board->hole_count; h++) {
+			if (bitboard_bits_test(targets, h)) {
+				heaviest = p->weights[h] > heaviest ? p->weights[h] : heaviest;
+				lightest = p->weights[h] < lightest ? p->weights[h] : lightest;
+			}
+		}
+		if (heaviest == p->max_weight && lightest > p->min_weight) {
+			set->pagodas[set->count] = p;
+			set->finals[set->count] = p->finals;
+			set->count++;
+		}
+	}
+	for (int j = 0; j < board->jump_count; j++) {
+		for (int i = 0; i < set->count; i++) {
+			set->jump_deltas[j * set->count + i] = set->pagodas[i]->jump_delta[j];
+		}
+	}
+	
+	if (pagoda_set_type_id < 0) {
+		pagoda_set_type_id = mem_type_id("pagoda_set");
+	}
+	mem_profile_resize(pagoda_set_type_id, 0, set_size(board, library->count));
+	set->board = board;
+}
+
+void pagoda_set_destroy(pagoda_set_t *set) {
+	mem_profile_resize(pagoda_set_type_id, set_size(set->board, pagoda_library(set->board)->count), 0);
+	free(set->pagodas);
+	free(set->finals);
+	free(set->jump_deltas);
+	set->count = 0;
+}
+
+const pagoda_library_t *pagoda_library(const board_t *board) {
+	int rows = board->rowcount;
+	if (rows >= library_count) {
+		pagoda_library_t **new_libraries = realloc(libraries, sizeof(pagoda_library_t *) * (rows + 1));
+		if (new_libraries == NULL) {
+			perror("Failed to grow the pagoda library table");
+			exit(1);
+		}
+		for (int i = library_count; i <= rows; i++) {
+			new_libraries[i] = NULL;
+		}
+		libraries = new_libraries;
+		library_count = rows + 1;
+	}
+	
+	if (libraries[rows] == NULL) {
+		libraries[rows] = library_new(board);
+	}
+	return libraries[rows];
+}
@@ -0,0 +1,114 @@
+/*
+ *  pagoda.h
+ *  performance_c
+ */
+
+#ifndef __PAGODA_H__
+#define __PAGODA_H__
+
+#include "bitboard.h"
+#include "board.h"
+
+/*
+ * Pagoda functions.
+ *
+ * A pagoda function gives each hole a weight, such that no jump can ever
+ * increase the total weight of the occupied holes: the weight of the hole
+ * a jump lands in is never more than the weights of the two holes it
+ * empties put together. So if the pegs of a position add up to less than
+ * the weight of some hole, no sequence of jumps can leave a lone peg in that
+ * hole. When every hole has been ruled out by one pagoda or another, the
+ * position can't be solved, and a search for solutions can skip it.
+ *
+ * A search for solutions that end in one of a set of target holes can
+ * skip a position once every target has been ruled out.
+ *
+ * Each board has a library of pagodas that are valid on it:
+ *
+ *   - one per coset of the sublattice of holes an even number of steps
+ *     apart in every direction. A jump never leaves its coset, so the
+ *     number of pegs in one can't go up.
+ *   - the corners of every triangle of side 1 or 2, pointing up or down,
+ *     that no jump can land in from outside. Only some of the ones by the
+ *     edges of the board qualify.
+ *   - one centred on each hole, weighing a hole d steps away F(D + 2 - d),
+ *     where F is the Fibonacci sequence and D the furthest any hole is
+ *     from the centre. Since F(k) + F(k + 1) = F(k + 2), a jump towards
+ *     the centre never gains anything.
+ *
+ * A position's value under each pagoda is kept up to date as moves are made
+ * with the per-jump deltas below.
+ */
+
+typedef struct pagoda {
+	const char *kind;        // where it comes from in the library
+	const int *weights;      // indexed by hole
+	int min_weight;
+	int max_weight;
+	int max_value;           // the sum of the weights
+	
+	// finals[v] is the set of holes a lone peg could end up in from a
+	// position with value v: those weighing no more than v
+	const bitboard_bits_t *finals;
+	
+	// the change in value each jump makes, indexed by jump id
+	const int *jump_delta;
+} pagoda_t;
+
+typedef struct pagoda_library {
+	int hole_count;
+	int count;
+	const pagoda_t *pagodas;
+} pagoda_library_t;
+
+// whether weights (one per hole of board) are non-negative and no jump on
+// board increases their total
+int pagoda_is_valid(const board_t *board, const int *weights);
+
+// the shared, immortal library for board, built the first time it's asked for
+const pagoda_library_t *pagoda_library(const board_t *board);
+
+// bb's value under p, added up from scratch
+int pagoda_value(const pagoda_t *p, bitboard_t bb);
+
+// The pagodas a search for solutions ending in one of targets checks,
+// laid out for it. These are the ones from the library under which a
+// target weighs the most, since the rest rarely rule one out, and every
+// target outweighs the lightest hole, since a position with any pegs at
+// all is worth at least that. When any hole will do, that leaves none.
+// A set isn't shared; it's set up with pagoda_set_init() and torn down
+// with pagoda_set_destroy().
+typedef struct pagoda_set {
+	const board_t *board;
+	bitboard_bits_t targets;
+	int count;
+	const pagoda_t **pagodas;
+	const bitboard_bits_t **finals;  // pagodas[i]->finals
+	
+	// how much each jump changes each pagoda's value:
+	// jump_deltas[jump_id * count + i] is pagodas[i]->jump_delta[jump_id]
+	int *jump_deltas;
+} pagoda_set_t;
+
+void pagoda_set_init(pagoda_set_t *set, const board_t *board, bitboard_bits_t targets);
+void pagoda_set_destroy(pagoda_set_t *set);
+
+// values after jump_id is applied to a position with values
+static inline void pagoda_set_apply(const pagoda_set_t *set, int jump_id, const int *values, int *after) {
+	const int *deltas = set->jump_deltas + jump_id * set->count;
+	for (int i = 0; i < set->count; i++) {
+		after[i] = values[i] + deltas[i];
+	}
+}
+
+// whether a position with the given values under the set's pagodas can
+// still end with a lone peg in one of its targets
+static inline int pagoda_set_can_finish(const pagoda_set_t *set, const int *values) {
+	bitboard_bits_t targets = set->targets;
+	for (int i = 0; i < set->count; i++) {
+		targets = bitboard_bits_and(targets, set->finals[i][values[i]]);
+	}
+	return !bitboard_bits_is_zero(targets);
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ *  sset.c
+ *  performance_c
+ */
+
+#include "sset.h"
+#include "alist.h"
+
+int sset_index_of(alist_t *set, void *item, int (*comparator)(void *, void *)) {
+	int lo = 0;
+	int hi = set->size - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) >> 1;
+		int cmp = comparator(set->entries[mid], item);
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else if (cmp > 0) {
+			hi = mid - 1;
+		} else {
+			return mid;
+		}
+	}
+	return -(lo + 1);
+}
+
+int sset_contains(alist_t *set, void *item, int (*comparator)(void *, void *)) {
+	return sset_index_of(set, item, comparator) >= 0;
+}
+
+int sset_insert(alist_t *set, void *item, int (*comparator)(void *, void *)) {
+	int idx = sset_index_of(set, item, comparator);
+	if (idx >= 0) {
+		return 0;
+	}
+	alist_insert_at(set, -(idx + 1), item);
+	return 1;
+}
+
+int sset_remove(alist_t *set, void *item, int (*comparator)(void *, void *)) {
+	int idx = sset_index_of(set, item, comparator);
+	if (idx < 0) {
+		return 0;
+	}
+	alist_remove_at(set, idx);
+	return 1;
+}
+
+int sset_replace(alist_t *set, void **items, int count, void *item,
+				 int (*comparator)(void *, void *)) {
+	return alist_replace_sorted(set, items, count, item, comparator);
+}
@@ -0,0 +1,45 @@
+/*
+ *  sset.h
+ *  performance_c
+ */
+
+#ifndef __SSET_H__
+#define __SSET_H__
+
+#include "alist.h"
+
+/*
+ * Sorted sets.
+ *
+ * A sorted set is an ordinary alist_t whose entries are kept in ascending
+ * order according to a comparator, with no two entries comparing equal.
+ * Membership tests, insertions and removals find their position by binary
+ * search, so they cost O(log n) comparisons instead of alist_index_of()'s
+ * O(n). Every sset_ function on a given set must be passed the same
+ * comparator, and the set must only be modified through the sset_
+ * functions (the read-only alist functions are fine).
+ *
+ * Copy a set with alist_new_copy(); a sorted list stays sorted.
+ */
+
+// returns the index of item in set, or if it isn't there, -(i + 1) where
+// i is the index at which it would have to be inserted
+int sset_index_of(alist_t *set, void *item, int (*comparator)(void *, void *));
+
+int sset_contains(alist_t *set, void *item, int (*comparator)(void *, void *));
+
+/* Returns 1 if item was added; 0 if it was already in the set */
+// item must be a pointer that was allocated by mem_alloc().
+int sset_insert(alist_t *set, void *item, int (*comparator)(void *, void *));
+
+/* Returns 1 if item was removed; 0 if item was not found */
+int sset_remove(alist_t *set, void *item, int (*comparator)(void *, void *));
+
+// removes the count items from the set and inserts item by merging them
+// against the entries in one pass, which also builds the set's own copy of
+// them if it was made with alist_new_copy(). Returns the number of items
+// that were found and removed; item is inserted even if some of them weren't.
+int sset_replace(alist_t *set, void **items, int count, void *item,
+				 int (*comparator)(void *, void *));
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ *  ttable.c
+ *  performance_c
+ */
+
+#include "ttable.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static int ttable_type_id = -1;
+
+// entries with a key of 0 are free, so a hash of 0 is stored as 1
+static inline uint64_t key_of(uint64_t hash) {
+	return hash != 0 ? hash : 1;
+}
+
+static inline memo_count_t load_count(const uint64_t *words) {
+	return (memo_count_t) __atomic_load_n(&words[1], __ATOMIC_RELAXED) << 64 |
+		   __atomic_load_n(&words[0], __ATOMIC_RELAXED);
+}
+
+static inline void store_count(uint64_t *words, memo_count_t n) {
+	__atomic_store_n(&words[0], (uint64_t) n, __ATOMIC_RELAXED);
+	__atomic_store_n(&words[1], (uint64_t) (n >> 64), __ATOMIC_RELAXED);
+}
+
+void ttable_init(ttable_t *table, size_t capacity) {
+	table->capacity = 1;
+	while (table->capacity < capacity) {
+		table->capacity *= 2;
+	}
+	table->entries = calloc(table->capacity, sizeof(ttable_entry_t));
+	if (table->entries == NULL) {
+		perror("Couldn't allocate transposition table");
+		exit(1);
+	}
+	
+	if (ttable_type_id < 0) {
+		ttable_type_id = mem_type_id("ttable");
+	}
+	mem_profile_resize(ttable_type_id, 0, sizeof(ttable_entry_t) * table->capacity);
+}
+
+void ttable_destroy(ttable_t *table) {
+	mem_profile_resize(ttable_type_id, sizeof(ttable_entry_t) * table->capacity, 0);
+	free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+}
+
+int ttable_find(const ttable_t *table, uint64_t hash, memo_count_t *games, memo_count_t *wins, ttable_stats_t *stats) {
+	uint64_t key = key_of(hash);
+	size_t mask = table->capacity - 1;
+	stats->lookups++;
+	
+	for (int p = 0; p < TTABLE_PROBES; p++) {
+		ttable_entry_t *e = &table->entries[(hash + p) & mask];
+		stats->probes++;
+		
+		uint64_t sequence = __atomic_load_n(&e->sequence, __ATOMIC_ACQUIRE);
+		uint64_t k = __atomic_load_n(&e->key, __ATOMIC_RELAXED);
+		if (k == 0) {
+			// entries are filled in probe order and never freed, so the
+			// position isn't any further along either
+			return 0;
+		}
+		if (k != key) {
+			stats->collisions++;
+			continue;
+		}
+		
+		memo_count_t g = load_count(e->games);
+		memo_count_t w = load_count(e->wins);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if ((sequence & 1) || __atomic_load_n(&e->sequence, __ATOMIC_RELAXED) != sequence) {
+			return 0;  // a writer had the entry, so what we read can't be trusted
+		}
+		
+		*games = g;
+		*wins = w;
+		stats->hits++;
+		return 1;
+	}
+	return 0;
+}
+
+void ttable_insert(ttable_t *table, uint64_t hash, memo_count_t games, memo_count_t wins, ttable_stats_t *stats) {
+	uint64_t key = key_of(hash);
+	size_t mask = table->capacity - 1;
+	stats->inserts++;
+	
+	// the first free entry, or failing that the cheapest one to lose
+	ttable_entry_t *victim = NULL;
+	memo_count_t victim_games = 0;
+	for (int p = 0; p < TTABLE_PROBES; p++) {
+		ttable_entry_t *e = &table->entries[(hash + p) & mask];
+		stats->probes++;
+		
+		uint64_t k = __atomic_load_n(&e->key, __ATOMIC_RELAXED);
+		if (k == key) {
+			return;  // another thread got here first
+		}
+		if (k == 0) {
+			victim = e;
+			break;
+		}
+		stats->collisions++;
+		
+		// a torn read here only makes for a worse choice of victim
+		memo_count_t g = load_count(e->games);
+		if (victim == NULL || g < victim_games) {
+			victim = e;
+			victim_games = g;
+		}
+	}
+	
+	uint64_t sequence = __atomic_load_n(&victim->sequence, __ATOMIC_RELAXED);
+	if ((sequence & 1) ||
+		!__atomic_compare_exchange_n(&victim->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		stats->races++;
+		return;
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	uint64_t old_key = __atomic_load_n(&victim->key, __ATOMIC_RELAXED);
+	if (old_key != 0 && old_key != key) {
+		stats->overwrites++;
+	}
+	__atomic_store_n(&victim->key, key, __ATOMIC_RELAXED);
+	store_count(victim->games, games);
+	store_count(victim->wins, wins);
+	
+	__atomic_store_n(&victim->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void ttable_stats_init(ttable_stats_t *stats) {
+	stats->lookups = 0;
+	stats->hits = 0;
+	stats->probes = 0;
+	stats->inserts = 0;
+	stats->collisions = 0;
+	stats->overwrites = 0;
+	stats->races = 0;
+}
+
+void ttable_stats_add(ttable_stats_t *total, const ttable_stats_t *stats) {
+	total->lookups += stats->lookups;
+	total->hits += stats->hits;
+	total->probes += stats->probes;
+	total->inserts += stats->inserts;
+	total->collisions += stats->collisions;
+	total->overwrites += stats->overwrites;
+	total->races += stats->races;
+}
+
+void ttable_stats_print(const ttable_t *table, const ttable_stats_t *stats) {
+	size_t used = 0;
+	for (size_t i = 0; i < table->capacity; i++) {
+		used += table->entries[i].key != 0;
+	}
+	long operations = stats->lookups + stats->inserts;
+	
+	printf("Table entries:   %6zu (%zu used)\n", table->capacity, used);
+	printf("Table lookups:   %6ld (%.1f%% hits)\n", stats->lookups,
+		   stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0);
+	printf("Table inserts:   %6ld\n", stats->inserts);
+	printf("Probe length:    %6.2f\n", operations ? (double) stats->probes / operations : 0.0);
+	printf("Collisions:      %6ld\n", stats->collisions);
+	printf("Overwrites:      %6ld\n", stats->overwrites);
+	printf("Lost races:      %6ld\n", stats->races);
+}
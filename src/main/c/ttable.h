@@ -0,0 +1,77 @@
+/*
+ *  ttable.h
+ *  performance_c
+ */
+
+#ifndef __TTABLE_H__
+#define __TTABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "memo.h"
+
+/*
+ * Transposition tables.
+ *
+ * A fixed-size table of game counts (see memo.h) that any number of
+ * threads can read and add to at once without taking a lock. Positions are
+ * looked up by their Zobrist hash alone (see board.h), so two positions
+ * with the same 64-bit hash share an entry; with the few million positions
+ * the boards here have, the odds of that are around one in a million.
+ *
+ * Each entry is guarded by a sequence number, as in a seqlock. A writer
+ * claims an entry by moving its sequence number from even to odd with a
+ * compare-and-swap, fills it in, and makes it even again. A reader never
+ * writes: it reads the sequence number, the entry and the sequence number
+ * again, and only trusts what it read if the number was even and didn't
+ * change.
+ *
+ * A position goes in one of the TTABLE_PROBES entries starting at its
+ * home slot. When they are all taken by other positions, the one with the
+ * fewest games below it is overwritten, since it is the cheapest to work
+ * out again.
+ */
+
+#define TTABLE_PROBES 4
+
+typedef struct ttable_entry {
+	uint64_t sequence;  // odd while a writer is filling the entry in
+	uint64_t key;       // the position's hash; 0 for a free entry
+	uint64_t games[2];  // memo_count_t counts, as low and high words
+	uint64_t wins[2];
+} ttable_entry_t;
+
+typedef struct ttable {
+	size_t capacity;  // always a power of two
+	ttable_entry_t *entries;
+} ttable_t;
+
+// what one thread did with a table. Each thread keeps its own, so counting
+// costs nothing but an increment; add them up with ttable_stats_add().
+typedef struct ttable_stats {
+	long lookups;
+	long hits;
+	long probes;      // entries looked at by lookups and inserts together
+	long inserts;
+	long collisions;  // entries skipped because another position had them
+	long overwrites;  // other positions' entries replaced by an insert
+	long races;       // inserts that lost an entry to another thread
+} ttable_stats_t;
+
+// capacity is rounded up to a power of two
+void ttable_init(ttable_t *table, size_t capacity);
+void ttable_destroy(ttable_t *table);
+
+// sets games and wins and returns 1 if the table has counts for hash,
+// otherwise returns 0
+int ttable_find(const ttable_t *table, uint64_t hash, memo_count_t *games, memo_count_t *wins, ttable_stats_t *stats);
+
+// records the counts for hash. This can fail when other threads are
+// writing the same entries, in which case the counts are simply not kept.
+void ttable_insert(ttable_t *table, uint64_t hash, memo_count_t games, memo_count_t wins, ttable_stats_t *stats);
+
+void ttable_stats_init(ttable_stats_t *stats);
+void ttable_stats_add(ttable_stats_t *total, const ttable_stats_t *stats);
+void ttable_stats_print(const ttable_t *table, const ttable_stats_t *stats);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ *  typed_list.h
+ *  performance_c
+ */
+
+#ifndef __TYPED_LIST_H__
+#define __TYPED_LIST_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "memory.h"
+
+/*
+ * Typed lists.
+ *
+ * DEFINE_TYPED_LIST(name, type, cmp) generates a list type name_t which
+ * stores values of the given type directly in its entries array, along with
+ * static inline functions name_init(), name_add() and so on that mirror the
+ * alist_ API. Because the element type and the comparator are known at
+ * compile time, searching calls cmp directly (so it can be inlined) and
+ * reading an entry doesn't chase a pointer. cmp must have the signature
+ *
+ *     int cmp(const type *lhs, const type *rhs);
+ *
+ * and is normally a static inline function defined next to the type.
+ *
+ * Unlike alist_t, a typed list is not a reference counted object: it lives
+ * wherever it is declared (on the stack, or inside another struct), must be
+ * set up with name_init() and torn down with name_destroy(), and copies its
+ * entries by value without retaining anything they point to. alist_t remains
+ * the general purpose container for reference counted objects.
+ *
+ * The entries arrays show up in the memory profile under the list's name.
+ */
+#define DEFINE_TYPED_LIST(name, type, cmp)                                          \
+                                                                                    \
+typedef struct name {                                                               \
+	int size;                                                                       \
+	int capacity;                                                                   \
+	type *entries;                                                                  \
+} name##_t;                                                                         \
+                                                                                    \
+static int name##_type_id = -1;                                                     \
+                                                                                    \
+static inline void name##_init(name##_t *list) {                                    \
+	list->size = 0;                                                                 \
+	list->capacity = 0;                                                             \
+	list->entries = NULL;                                                           \
+}                                                                                   \
+                                                                                    \
+static inline void name##_destroy(name##_t *list) {                                 \
+	if (list->entries != NULL) {                                                    \
+		mem_profile_resize(name##_type_id, sizeof(type) * list->capacity, 0);       \
+		free(list->entries);                                                        \
+	}                                                                               \
+	name##_init(list);                                                              \
+}                                                                                   \
+                                                                                    \
+static inline void name##_reserve(name##_t *list, int capacity) {                   \
+	if (capacity <= list->capacity) {                                               \
+		return;                                                                     \
+	}                                                                               \
+	if (name##_type_id < 0) {                                                       \
+		name##_type_id = mem_type_id(#name);                                        \
+	}                                                                               \
+	type *new_ents = realloc(list->entries, sizeof(type) * capacity);               \
+	if (new_ents == NULL) {                                                         \
+		perror("Failed to resize " #name);                                          \
+		exit(1);                                                                    \
+	}                                                                               \
+	mem_profile_resize(name##_type_id, sizeof(type) * list->capacity,               \
+					   sizeof(type) * capacity);                                    \
+	list->entries = new_ents;                                                       \
+	list->capacity = capacity;                                                      \
+}                                                                                   \
+                                                                                    \
+static inline void name##_add(name##_t *list, type item) {                          \
+	if (list->size == list->capacity) {                                             \
+		name##_reserve(list, list->capacity < 8 ? 8 : list->capacity * 2);          \
+	}                                                                               \
+	list->entries[list->size++] = item;                                             \
+}                                                                                   \
+                                                                                    \
+static inline type *name##_at(name##_t *list, int idx) {                            \
+	if (idx >= list->size || idx < 0) {                                             \
+		printf("Out-of-bounds " #name " access. idx=%d; size=%d\n",                 \
+			   idx, list->size);                                                    \
+		exit(1);                                                                    \
+	}                                                                               \
+	return &list->entries[idx];                                                     \
+}                                                                                   \
+                                                                                    \
+static inline type name##_get(name##_t *list, int idx) {                            \
+	return *name##_at(list, idx);                                                   \
+}                                                                                   \
+                                                                                    \
+static inline void name##_remove_at(name##_t *list, int idx) {                      \
+	name##_at(list, idx);                                                           \
+	memmove(list->entries + idx, list->entries + idx + 1,                           \
+			sizeof(type) * (list->size - (idx + 1)));                               \
+	list->size--;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline void name##_swap_remove(name##_t *list, int idx) {                    \
+	name##_at(list, idx);                                                           \
+	list->entries[idx] = list->entries[--list->size];                               \
+}                                                                                   \
+                                                                                    \
+static inline void name##_remove_last(name##_t *list) {                             \
+	name##_at(list, list->size - 1);                                                \
+	list->size--;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline void name##_clear(name##_t *list) {                                   \
+	list->size = 0;                                                                 \
+}                                                                                   \
+                                                                                    \
+static inline int name##_index_of(name##_t *list, const type *item) {               \
+	for (int i = 0; i < list->size; i++) {                                          \
+		if (cmp(item, &list->entries[i]) == 0) {                                    \
+			return i;                                                               \
+		}                                                                           \
+	}                                                                               \
+	return -1;                                                                      \
+}                                                                                   \
+                                                                                    \
+static inline int name##_contains(name##_t *list, const type *item) {               \
+	return name##_index_of(list, item) != -1;                                       \
+}                                                                                   \
+                                                                                    \
+/* binary search; only meaningful if the list is sorted by cmp. Returns */         \
+/* -(i + 1) if item isn't found, where i is where it would be inserted. */         \
+static inline int name##_sorted_index_of(name##_t *list, const type *item) {        \
+	int lo = 0;                                                                     \
+	int hi = list->size - 1;                                                        \
+	while (lo <= hi) {                                                              \
+		int mid = (lo + hi) >> 1;                                                   \
+		int c = cmp(&list->entries[mid], item);                                     \
+		if (c < 0) {                                                                \
+			lo = mid + 1;                                                           \
+		} else if (c > 0) {                                                         \
+			hi = mid - 1;                                                           \
+		} else {                                                                    \
+			return mid;                                                             \
+		}                                                                           \
+	}                                                                               \
+	return -(lo + 1);                                                               \
+}                                                                                   \
+                                                                                    \
+static inline int name##_size(name##_t *list) {                                     \
+	return list->size;                                                              \
+}                                                                                   \
+                                                                                    \
+static inline int name##_is_empty(name##_t *list) {                                 \
+	return list->size == 0;                                                         \
+}
+
+#endif